@@ -41,6 +41,7 @@ namespace GUI
             this.BtnBuildMap = new System.Windows.Forms.Button();
             this.BoxLock = new System.Windows.Forms.GroupBox();
             this.BtnSpectrum = new System.Windows.Forms.Button();
+            this.BtnCompare = new System.Windows.Forms.Button();
             this.BtnVariance = new System.Windows.Forms.Button();
             this.BtnMode = new System.Windows.Forms.Button();
             this.BtnBrowseLockOutputFolder = new System.Windows.Forms.Button();
@@ -167,6 +168,7 @@ namespace GUI
             // 
             // BoxLock
             // 
+            this.BoxLock.Controls.Add(this.BtnCompare);
             this.BoxLock.Controls.Add(this.BtnSpectrum);
             this.BoxLock.Controls.Add(this.BtnVariance);
             this.BoxLock.Controls.Add(this.BtnMode);
@@ -184,10 +186,21 @@ namespace GUI
             this.BoxLock.TabStop = false;
             this.BoxLock.Text = "Lock Z position";
             // 
+            // BtnCompare
+            // 
+            this.BtnCompare.BackColor = System.Drawing.Color.PaleGreen;
+            this.BtnCompare.Location = new System.Drawing.Point(570, 180);
+            this.BtnCompare.Name = "BtnCompare";
+            this.BtnCompare.Size = new System.Drawing.Size(160, 40);
+            this.BtnCompare.TabIndex = 9;
+            this.BtnCompare.Text = "Compare methods";
+            this.BtnCompare.UseVisualStyleBackColor = false;
+            this.BtnCompare.Click += new System.EventHandler(this.BtnCompare_Click);
+            // 
             // BtnSpectrum
             // 
             this.BtnSpectrum.BackColor = System.Drawing.Color.PaleGreen;
-            this.BtnSpectrum.Location = new System.Drawing.Point(510, 180);
+            this.BtnSpectrum.Location = new System.Drawing.Point(390, 180);
             this.BtnSpectrum.Name = "BtnSpectrum";
             this.BtnSpectrum.Size = new System.Drawing.Size(160, 40);
             this.BtnSpectrum.TabIndex = 8;
@@ -198,7 +211,7 @@ namespace GUI
             // BtnVariance
             // 
             this.BtnVariance.BackColor = System.Drawing.Color.PaleGreen;
-            this.BtnVariance.Location = new System.Drawing.Point(270, 180);
+            this.BtnVariance.Location = new System.Drawing.Point(210, 180);
             this.BtnVariance.Name = "BtnVariance";
             this.BtnVariance.Size = new System.Drawing.Size(160, 40);
             this.BtnVariance.TabIndex = 7;
@@ -323,6 +336,7 @@ namespace GUI
         private System.Windows.Forms.Button BtnBrowseLockOutputFolder;
         private System.Windows.Forms.Button BtnBrowseLockInputFolder;
         private System.Windows.Forms.Button BtnSpectrum;
+        private System.Windows.Forms.Button BtnCompare;
         private System.Windows.Forms.Button BtnVariance;
         private System.Windows.Forms.Button BtnMode;
     }
@@ -144,6 +144,15 @@ namespace GUI
             SetControlsEnabled(true);
         }
 
+        private void BtnCompare_Click(object sender, EventArgs e)
+        {
+            SetControlsEnabled(false);
+            MapWrapper.loadPositionsZ();
+            MapWrapper.overrideString(keyFocusingMethod, "Compare");
+            MapWrapper.calculateDepth();
+            SetControlsEnabled(true);
+        }
+
         private void BtnClose_Click(object sender, EventArgs e)
         {
             Close();
@@ -1,9 +1,14 @@
-﻿using System.Runtime.InteropServices;
+﻿using System;
+using System.Runtime.InteropServices;
 
 namespace GUI
 {
     class MapWrapper
     {
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        public delegate void ProgressCallback(string stageName, int itemsDone, int itemsNum,
+            double elapsedMilliseconds, IntPtr userData);
+
         [DllImport(@"Map3D.dll")]
         public static extern void loadConfig(string configFilename);
 
@@ -13,6 +18,16 @@ namespace GUI
         [DllImport(@"Map3D.dll")]
         public static extern void buildMap();
 
+        [DllImport(@"Map3D.dll")]
+        public static extern void beginTileScan(float startX, float startY, float stepX, float stepY,
+            int countX, int countY, int tileRows, int tileCols);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void addTile(byte[] pixels, int rows, int cols, int stride, float x, float y, float z);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void finalizeTileScan();
+
         [DllImport(@"Map3D.dll")]
         public static extern void saveStiched();
 
@@ -26,6 +41,12 @@ namespace GUI
 
         public static extern void describeCapillaries();
 
+        [DllImport(@"Map3D.dll")]
+        public static extern void sweepParameters(string grid);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void processMap();
+
         [DllImport(@"Map3D.dll")]
         public static extern void loadPositionsZ();
 
@@ -38,6 +59,25 @@ namespace GUI
         [DllImport(@"Map3D.dll")]
         public static extern void calculateDepth();
 
+        [DllImport(@"Map3D.dll")]
+        public static extern void validateCalibration();
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void initFocusLock();
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void loadFocusLockCalibration(string calibrationFilename);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void setFocusLockCalibration(float slope, float offset);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern float processFocusLockFrame(byte[] pixels, int rows, int cols, int stride);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void getFocusLockLatency(out int framesNum,
+            out double p50, out double p90, out double p99, out double max);
+
         [DllImport(@"Map3D.dll")]
         public static extern void overrideInt(string key, int val);
 
@@ -46,5 +86,152 @@ namespace GUI
 
         [DllImport(@"Map3D.dll")]
         public static extern void overrideString(string key, string val);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern IntPtr createSession();
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void destroySession(IntPtr session);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void sessionLoadConfig(IntPtr session, string configFilename);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void sessionOverrideInt(IntPtr session, string key, int val);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void sessionOverrideFloat(IntPtr session, string key, float val);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void sessionOverrideString(IntPtr session, string key, string val);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void sessionBuildMap(IntPtr session);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void sessionBeginTileScan(IntPtr session, float startX, float startY, float stepX, float stepY,
+            int countX, int countY, int tileRows, int tileCols);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void sessionAddTile(IntPtr session, byte[] pixels, int rows, int cols, int stride,
+            float x, float y, float z);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void sessionFinalizeTileScan(IntPtr session);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void sessionPrintValueAtTruncatedPos(IntPtr session, float x, float y, float z);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void sessionSaveStiched(IntPtr session);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void sessionDetectCapillaries(IntPtr session);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void sessionDescribeCapillaries(IntPtr session);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void sessionSweepParameters(IntPtr session, string grid);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void sessionProcessMap(IntPtr session);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern int sessionGetLayersNum(IntPtr session);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern int sessionGetBestLayerIndex(IntPtr session);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void sessionLoadPositionsZ(IntPtr session);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void sessionBuildSequence(IntPtr session);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void sessionSaveProjections(IntPtr session);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void sessionCalculateDepth(IntPtr session);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void sessionValidateCalibration(IntPtr session);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void sessionInitFocusLock(IntPtr session);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void sessionLoadFocusLockCalibration(IntPtr session, string calibrationFilename);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void sessionSetFocusLockCalibration(IntPtr session, float slope, float offset);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern float sessionProcessFocusLockFrame(IntPtr session, byte[] pixels, int rows, int cols, int stride);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void sessionGetFocusLockLatency(IntPtr session, out int framesNum,
+            out double p50, out double p90, out double p99, out double max);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern IntPtr buildMapAsync(ProgressCallback callback, IntPtr userData);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern IntPtr detectCapillariesAsync(ProgressCallback callback, IntPtr userData);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern IntPtr describeCapillariesAsync(ProgressCallback callback, IntPtr userData);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern IntPtr processMapAsync(ProgressCallback callback, IntPtr userData);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern IntPtr calculateDepthAsync(ProgressCallback callback, IntPtr userData);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern IntPtr sessionBuildMapAsync(IntPtr session, ProgressCallback callback, IntPtr userData);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern IntPtr sessionDetectCapillariesAsync(IntPtr session, ProgressCallback callback, IntPtr userData);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern IntPtr sessionDescribeCapillariesAsync(IntPtr session, ProgressCallback callback, IntPtr userData);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern IntPtr sessionProcessMapAsync(IntPtr session, ProgressCallback callback, IntPtr userData);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern IntPtr sessionSweepParametersAsync(IntPtr session, string grid, ProgressCallback callback, IntPtr userData);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern IntPtr sessionCalculateDepthAsync(IntPtr session, ProgressCallback callback, IntPtr userData);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern IntPtr sessionValidateCalibrationAsync(IntPtr session, ProgressCallback callback, IntPtr userData);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void cancelJob(IntPtr job);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern int waitJob(IntPtr job);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern int getJobStatus(IntPtr job);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern IntPtr getJobError(IntPtr job);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void destroyJob(IntPtr job);
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void startTracing();
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void stopTracing();
+
+        [DllImport(@"Map3D.dll")]
+        public static extern void saveTrace(string traceFilename);
     };
 }
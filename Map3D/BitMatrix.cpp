@@ -0,0 +1,305 @@
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define BIT_MATRIX_SSE2
+#endif
+
+#include "BitMatrix.h"
+
+// Number of bits to count number of set pixels in 3x3 neighborhood: up to 9
+const size_t COUNTER_BITS = 4;
+
+BitMatrix::BitMatrix()
+{
+	m_rows = 0;
+	m_cols = 0;
+	m_wordsInRow = 0;
+	m_buffer = nullptr;
+}
+
+BitMatrix::BitMatrix(const size_t rows, const size_t cols)
+{
+	m_rows = rows;
+	m_cols = cols;
+	m_wordsInRow = (cols + BITS_IN_WORD - 1) / BITS_IN_WORD;
+	if ((m_rows <= 0) || (m_cols <= 0))
+	{
+		m_buffer = nullptr;
+		return;
+	}
+	m_buffer = std::make_shared<word[]>(m_rows * m_wordsInRow);
+}
+
+BitMatrix::BitMatrix(ByteMatrix& byteMatrix, byte delim) : BitMatrix(byteMatrix.rows(), byteMatrix.cols())
+{
+	for (size_t row = 0; row < m_rows; row++)
+	{
+		const byte* pixels = byteMatrix.getBuffer() + row * m_cols;
+		word* rowWords = getRow(row);
+		size_t col = 0;
+#ifdef BIT_MATRIX_SSE2
+		// 16 pixels compared at once give 16 bits by movemask: they never cross a word since 16 divides 64
+		if (delim < WHITE)
+		{
+			const size_t pixelsInRegister = sizeof(__m128i);
+			__m128i threshold = _mm_set1_epi8((char)(delim + 1));
+			for (; col + pixelsInRegister <= m_cols; col += pixelsInRegister)
+			{
+				__m128i packedPixels = _mm_loadu_si128((const __m128i*)(pixels + col));
+				__m128i overDelim = _mm_cmpeq_epi8(_mm_max_epu8(packedPixels, threshold), packedPixels);
+				word bits = (word)(uint32_t)_mm_movemask_epi8(overDelim);
+				rowWords[col / BITS_IN_WORD] |= bits << (col % BITS_IN_WORD);
+			}
+		}
+#endif
+		for (; col < m_cols; col++)
+		{
+			rowWords[col / BITS_IN_WORD] |= (word)(pixels[col] > delim) << (col % BITS_IN_WORD);
+		}
+	}
+}
+
+size_t BitMatrix::rows()
+{
+	return m_rows;
+}
+
+size_t BitMatrix::cols()
+{
+	return m_cols;
+}
+
+size_t BitMatrix::wordsInRow()
+{
+	return m_wordsInRow;
+}
+
+word* BitMatrix::getRow(size_t row)
+{
+	return m_buffer.get() + m_wordsInRow * row;
+}
+
+bool BitMatrix::get(size_t row, size_t col)
+{
+	return (getRow(row)[col / BITS_IN_WORD] >> (col % BITS_IN_WORD)) & 1;
+}
+
+void BitMatrix::set(size_t row, size_t col)
+{
+	getRow(row)[col / BITS_IN_WORD] |= (word)1 << (col % BITS_IN_WORD);
+}
+
+void BitMatrix::clean()
+{
+	memset(m_buffer.get(), 0, m_rows * m_wordsInRow * sizeof(word));
+}
+
+size_t BitMatrix::countInRow(size_t row, size_t colBegin, size_t numCols)
+{
+	if (numCols == 0)
+	{
+		return 0;
+	}
+
+	word* rowWords = getRow(row);
+	size_t colEnd = colBegin + numCols - 1;
+	size_t wordBegin = colBegin / BITS_IN_WORD;
+	size_t wordEnd = colEnd / BITS_IN_WORD;
+
+	// Masks of bits in the first and the last words of the range
+	word maskBegin = ~(word)0 << (colBegin % BITS_IN_WORD);
+	word maskEnd = ~(word)0 >> (BITS_IN_WORD - 1 - colEnd % BITS_IN_WORD);
+	if (wordBegin == wordEnd)
+	{
+		return std::popcount(rowWords[wordBegin] & maskBegin & maskEnd);
+	}
+
+	size_t count = std::popcount(rowWords[wordBegin] & maskBegin);
+	for (size_t wordIndex = wordBegin + 1; wordIndex < wordEnd; wordIndex++)
+	{
+		count += std::popcount(rowWords[wordIndex]);
+	}
+	count += std::popcount(rowWords[wordEnd] & maskEnd);
+	return count;
+}
+
+std::vector<size_t> BitMatrix::countInCols()
+{
+	// Bit-sliced counters: bit i of each column count is kept in word i of counters of the column word,
+	// so a row is added to 64 columns at once by carry propagation
+	size_t counterBits = std::max<size_t>(std::bit_width(m_rows), 1);
+	std::vector<word> counters(m_wordsInRow * counterBits, 0);
+	for (size_t row = 0; row < m_rows; row++)
+	{
+		word* rowWords = getRow(row);
+		for (size_t wordIndex = 0; wordIndex < m_wordsInRow; wordIndex++)
+		{
+			word* counter = counters.data() + wordIndex * counterBits;
+			word carry = rowWords[wordIndex];
+			for (size_t bit = 0; (carry != 0) && (bit < counterBits); bit++)
+			{
+				word nextCarry = counter[bit] & carry;
+				counter[bit] ^= carry;
+				carry = nextCarry;
+			}
+		}
+	}
+
+	std::vector<size_t> counts(m_cols, 0);
+	for (size_t col = 0; col < m_cols; col++)
+	{
+		const word* counter = counters.data() + (col / BITS_IN_WORD) * counterBits;
+		size_t shift = col % BITS_IN_WORD;
+		for (size_t bit = 0; bit < counterBits; bit++)
+		{
+			counts[col] |= (size_t)((counter[bit] >> shift) & 1) << bit;
+		}
+	}
+	return counts;
+}
+
+void BitMatrix::gradientY(BitMatrix& dst)
+{
+	dst.clean();
+	for (size_t row = 1; row + 1 < m_rows; row++)
+	{
+		word* prevRow = getRow(row - 1);
+		word* nextRow = getRow(row + 1);
+		word* dstRow = dst.getRow(row);
+		for (size_t wordIndex = 0; wordIndex < m_wordsInRow; wordIndex++)
+		{
+			dstRow[wordIndex] = prevRow[wordIndex] ^ nextRow[wordIndex];
+		}
+	}
+}
+
+void BitMatrix::dilate(BitMatrix& dst, size_t minNeighbors,
+	size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd)
+{
+	dst.clean();
+
+	// Neighborhood of each pixel in the area must be within the matrix
+	rowBegin = std::max<size_t>(rowBegin, 1);
+	rowEnd = std::min(rowEnd, m_rows - 2);
+	colBegin = std::max<size_t>(colBegin, 1);
+	colEnd = std::min(colEnd, m_cols - 2);
+	if ((rowBegin > rowEnd) || (colBegin > colEnd))
+	{
+		return;
+	}
+
+	// Words of the area columns with the masks of partially covered first and last words
+	size_t wordBegin = colBegin / BITS_IN_WORD;
+	size_t wordEnd = colEnd / BITS_IN_WORD;
+	word maskBegin = ~(word)0 << (colBegin % BITS_IN_WORD);
+	word maskEnd = ~(word)0 >> (BITS_IN_WORD - 1 - colEnd % BITS_IN_WORD);
+
+	// Centers of filled neighborhoods in the row
+	std::vector<word> centers(m_wordsInRow);
+
+	for (size_t row = rowBegin; row <= rowEnd; row++)
+	{
+		word* rowsAround[] = { getRow(row - 1), getRow(row), getRow(row + 1) };
+
+		for (size_t wordIndex = wordBegin; wordIndex <= wordEnd; wordIndex++)
+		{
+			// Bit-sliced counters of set pixels in 3x3 neighborhood of each of 64 pixels in the word
+			word counter[COUNTER_BITS] = {};
+			for (word* rowWords : rowsAround)
+			{
+				word prevWord = wordIndex > 0 ? rowWords[wordIndex - 1] : 0;
+				word nextWord = wordIndex + 1 < m_wordsInRow ? rowWords[wordIndex + 1] : 0;
+				word neighbors[] =
+				{
+					(rowWords[wordIndex] << 1) | (prevWord >> (BITS_IN_WORD - 1)),
+					rowWords[wordIndex],
+					(rowWords[wordIndex] >> 1) | (nextWord << (BITS_IN_WORD - 1))
+				};
+				for (word neighbor : neighbors)
+				{
+					word carry = neighbor;
+					for (size_t bit = 0; bit < COUNTER_BITS; bit++)
+					{
+						word nextCarry = counter[bit] & carry;
+						counter[bit] ^= carry;
+						carry = nextCarry;
+					}
+				}
+			}
+
+			// Compare counters with the minimal number of neighbors from the most significant bit
+			word greater = 0;
+			word equal = ~(word)0;
+			for (size_t bit = COUNTER_BITS; bit-- > 0;)
+			{
+				if ((minNeighbors >> bit) & 1)
+				{
+					equal &= counter[bit];
+				}
+				else
+				{
+					greater |= equal & counter[bit];
+					equal &= ~counter[bit];
+				}
+			}
+			word center = greater | equal;
+
+			// Only centers within the area columns are taken
+			if (wordIndex == wordBegin)
+			{
+				center &= maskBegin;
+			}
+			if (wordIndex == wordEnd)
+			{
+				center &= maskEnd;
+			}
+			centers[wordIndex] = center;
+		}
+
+		// Spread centers horizontally to their left and right neighbors
+		for (size_t wordIndex = wordBegin; wordIndex <= wordEnd; wordIndex++)
+		{
+			word prevCenter = wordIndex > wordBegin ? centers[wordIndex - 1] : 0;
+			word nextCenter = wordIndex < wordEnd ? centers[wordIndex + 1] : 0;
+			word spread = centers[wordIndex] |
+				(centers[wordIndex] << 1) | (prevCenter >> (BITS_IN_WORD - 1)) |
+				(centers[wordIndex] >> 1) | (nextCenter << (BITS_IN_WORD - 1));
+
+			// Neighbor words out of the area receive bits spread over the area boundary
+			if ((wordIndex == wordBegin) && (wordIndex > 0))
+			{
+				word carryLeft = centers[wordIndex] << (BITS_IN_WORD - 1);
+				for (size_t dstRow = row - 1; dstRow <= row + 1; dstRow++)
+				{
+					dst.getRow(dstRow)[wordIndex - 1] |= carryLeft;
+				}
+			}
+			if ((wordIndex == wordEnd) && (wordIndex + 1 < m_wordsInRow))
+			{
+				word carryRight = centers[wordIndex] >> (BITS_IN_WORD - 1);
+				for (size_t dstRow = row - 1; dstRow <= row + 1; dstRow++)
+				{
+					dst.getRow(dstRow)[wordIndex + 1] |= carryRight;
+				}
+			}
+
+			// Spread vertically to rows above and below the center row
+			for (size_t dstRow = row - 1; dstRow <= row + 1; dstRow++)
+			{
+				dst.getRow(dstRow)[wordIndex] |= spread;
+			}
+		}
+	}
+}
+
+ByteMatrix BitMatrix::asByteMatrix(byte foreground, byte background)
+{
+	ByteMatrix byteMatrix(m_rows, m_cols);
+	for (size_t row = 0; row < m_rows; row++)
+	{
+		for (size_t col = 0; col < m_cols; col++)
+		{
+			byteMatrix.set(row, col, get(row, col) ? foreground : background);
+		}
+	}
+	return byteMatrix;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+
+#include "ByteMatrix.h"
+
+typedef uint64_t word;
+
+const size_t BITS_IN_WORD = 64;
+
+/*
+	Binary mask with one bit per pixel packed into 64-bit words along each row.
+	Bit j of word w in a row corresponds to column (64 * w + j).
+	Counting is performed by popcount and morphology by shifts, AND and OR on whole words.
+*/
+class BitMatrix
+{
+public:
+	BitMatrix();
+	BitMatrix(const size_t rows, const size_t cols);
+
+	// Pixels of the byte matrix over the delimiter become set bits
+	BitMatrix(ByteMatrix& byteMatrix, byte delim);
+	size_t rows();
+	size_t cols();
+	size_t wordsInRow();
+	word* getRow(size_t row);
+	bool get(size_t row, size_t col);
+	void set(size_t row, size_t col);
+	void clean();
+
+	// Number of set bits in the row within columns [colBegin, colBegin + numCols)
+	size_t countInRow(size_t row, size_t colBegin, size_t numCols);
+
+	// Number of set bits in each column
+	std::vector<size_t> countInCols();
+
+	// Vertical gradient: XOR of rows above and below, the first and the last rows are cleared
+	void gradientY(BitMatrix& dst);
+
+	// Set 3x3 neighborhood in destination around each pixel of given area with at least minNeighbors set in 3x3
+	void dilate(BitMatrix& dst, size_t minNeighbors,
+		size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd);
+
+	// Set bits are shown as foreground and cleared bits as background
+	ByteMatrix asByteMatrix(byte foreground, byte background);
+
+protected:
+	size_t m_rows;
+	size_t m_cols;
+	size_t m_wordsInRow;
+	std::shared_ptr<word[]> m_buffer;
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+
+/*
+	Queue between threads of the pipeline with limited number of items.
+	Producer waits while the queue is full, consumer waits while the queue is empty.
+*/
+template <typename T>
+class BoundedQueue
+{
+public:
+	BoundedQueue(size_t capacity)
+	{
+		m_capacity = capacity;
+		m_isClosed = false;
+		m_isAborted = false;
+	}
+
+	// Returns false if the queue is aborted and the item is not added
+	bool push(const T& item)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notFull.wait(lock, [this]() { return m_isAborted || (m_items.size() < m_capacity); });
+		if (m_isAborted)
+		{
+			return false;
+		}
+		m_items.push(item);
+		m_notEmpty.notify_one();
+		return true;
+	}
+
+	// Returns false if the queue is closed and all items are taken or the queue is aborted
+	bool pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notEmpty.wait(lock, [this]() { return m_isAborted || m_isClosed || !m_items.empty(); });
+		if (m_isAborted || m_items.empty())
+		{
+			return false;
+		}
+		item = m_items.front();
+		m_items.pop();
+		m_notFull.notify_one();
+		return true;
+	}
+
+	// No more items will be pushed
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_isClosed = true;
+		m_notEmpty.notify_all();
+	}
+
+	// Both sides stop waiting and remaining items are dropped
+	void abort()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_isAborted = true;
+		m_items = std::queue<T>();
+		m_notEmpty.notify_all();
+		m_notFull.notify_all();
+	}
+
+private:
+	size_t m_capacity;
+	bool m_isClosed;
+	bool m_isAborted;
+	std::queue<T> m_items;
+
+	std::mutex m_mutex;
+	std::condition_variable m_notFull;
+	std::condition_variable m_notEmpty;
+};
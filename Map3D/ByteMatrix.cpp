@@ -20,6 +20,41 @@ ByteMatrix::ByteMatrix(const size_t rows, const size_t cols)
 	m_buffer = std::make_shared<byte[]>(m_rows * m_cols);
 }
 
+// Alias existing buffer - ownership is shared with other holders of the buffer
+ByteMatrix::ByteMatrix(const size_t rows, const size_t cols, const std::shared_ptr<byte[]>& buffer)
+{
+	m_rows = rows;
+	m_cols = cols;
+	m_buffer = buffer;
+}
+
+// Adopt pixels of 8-bit image without copy - the image data is kept alive while the matrix uses it
+ByteMatrix::ByteMatrix(const cv::Mat& image)
+{
+	m_rows = (size_t)image.rows;
+	m_cols = (size_t)image.cols;
+	if (image.empty())
+	{
+		m_buffer = nullptr;
+		return;
+	}
+
+	// Rows of the matrix must be contiguous: only image with padded rows is copied
+	cv::Mat adoptedImage = image.isContinuous() ? image : image.clone();
+	m_buffer = std::shared_ptr<byte[]>(adoptedImage.data, [adoptedImage](byte*) {});
+}
+
+// Copy of pixels into own buffer - copying of the matrix itself shares the buffer
+ByteMatrix ByteMatrix::clone() const
+{
+	ByteMatrix copy(m_rows, m_cols);
+	if (m_buffer != nullptr)
+	{
+		memcpy(copy.getBuffer(), m_buffer.get(), m_rows * m_cols);
+	}
+	return copy;
+}
+
 size_t ByteMatrix::rows()
 {
 	return m_rows;
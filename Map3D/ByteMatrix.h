@@ -12,6 +12,9 @@ class ByteMatrix
 public:
 	ByteMatrix();
 	ByteMatrix(const size_t rows, const size_t cols);
+	ByteMatrix(const size_t rows, const size_t cols, const std::shared_ptr<byte[]>& buffer);
+	ByteMatrix(const cv::Mat& image);
+	ByteMatrix clone() const;
 	size_t rows();
 	size_t cols();
 	byte* getBuffer();
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <map>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <fstream>
+#include <numeric>
+#include <algorithm>
+
+#include "FocusMetrics.h"
+
+#pragma warning(disable: 26812)
+
+// Image markers of sequences: key consists of folder, metric and parameters of the metric
+class MarkerCache
+{
+public:
+	bool find(const std::string& key, size_t framesNum, std::vector<float>& markers)
+	{
+		auto found = m_markers.find(key);
+		if ((found == m_markers.end()) || (found->second.size() != framesNum))
+		{
+			return false;
+		}
+		markers = found->second;
+		return true;
+	}
+
+	void store(const std::string& key, const std::vector<float>& markers)
+	{
+		m_markers[key] = markers;
+	}
+
+	void clear()
+	{
+		m_markers.clear();
+	}
+
+	static std::string makeKey(const std::string& imagesFolderName, FocusMetricType metricType,
+		const ConfigSnapshot& config)
+	{
+		std::string key = imagesFolderName + "|" + focusMetricNames[metricType] + "|";
+		switch (metricType)
+		{
+		case FocusMetricType::METRIC_MODE:
+			return key + std::to_string(config.focusing.modeImagePartCenter);
+		case FocusMetricType::METRIC_VARIANCE:
+			return key + std::to_string(config.focusing.varianceImagePartCenter);
+		case FocusMetricType::METRIC_SPECTRUM:
+			return key +
+				std::to_string(config.focusing.spectrumSizeFFT) + "," +
+				std::to_string(config.focusing.spectrumSizeEnergy) + "," +
+				std::to_string(config.focusing.spectrumNormalization);
+		default:
+			return key + std::to_string(config.focusing.gradientImagePartCenter);
+		}
+	}
+
+private:
+	std::map<std::string, std::vector<float>> m_markers;
+};
+
+// Z position calculated for a test sample by regression fitted without it
+struct ValidationSample
+{
+	size_t splitIndex;
+	size_t posIndex;
+	float positionZ;
+	float positionCalc;
+};
+
+struct ValidationResult
+{
+	std::vector<ValidationSample> samples;
+	float meanError;
+	float rmsError;
+	float maxAbsError;
+};
+
+// Validates regression of Z on image markers by splits of computed markers into calibration and test parts
+class CalibrationEngine
+{
+public:
+	CalibrationEngine()
+	{
+		m_validationType = ValidationType::VALIDATION_EVEN_ODD;
+		m_folds = 0;
+		m_repeats = 0;
+		m_seed = 0;
+	}
+
+	void init(const ConfigSnapshot& config)
+	{
+		initConfig(config);
+	}
+
+	ValidationResult validate(const std::vector<float>& markers, const std::vector<float>& positionsZ)
+	{
+		size_t n = markers.size();
+		if (positionsZ.size() != n)
+		{
+			throw std::exception("Data sizes mismatch");
+		}
+		if (n < 2)
+		{
+			throw std::exception("Validation of calibration requires at least 2 samples");
+		}
+
+		// Regression of all samples: calibration part is the total with test samples removed
+		RegressionAccumulator totalAccumulator;
+		for (size_t posIndex = 0; posIndex < n; posIndex++)
+		{
+			totalAccumulator.add(markers[posIndex], positionsZ[posIndex]);
+		}
+
+		// Split index of each sample for each split
+		std::vector<std::vector<size_t>> splits = makeSplits(n);
+
+		ValidationResult result{};
+		for (size_t splitIndex = 0; splitIndex < splits.size(); splitIndex++)
+		{
+			const std::vector<size_t>& testIndices = splits[splitIndex];
+			RegressionAccumulator calibrationAccumulator = totalAccumulator;
+			for (size_t posIndex : testIndices)
+			{
+				calibrationAccumulator.remove(markers[posIndex], positionsZ[posIndex]);
+			}
+
+			RegressionResult regression = calibrationAccumulator.fit();
+			for (size_t posIndex : testIndices)
+			{
+				float positionCalc = regression.slope * markers[posIndex] + regression.offset;
+				result.samples.push_back(ValidationSample{ splitIndex, posIndex, positionsZ[posIndex], positionCalc });
+			}
+		}
+
+		double sumError = 0.0;
+		double sumError2 = 0.0;
+		for (const ValidationSample& sample : result.samples)
+		{
+			double error = (double)sample.positionCalc - sample.positionZ;
+			sumError += error;
+			sumError2 += error * error;
+			result.maxAbsError = std::max(result.maxAbsError, (float)std::abs(error));
+		}
+		if (!result.samples.empty())
+		{
+			result.meanError = (float)(sumError / result.samples.size());
+			result.rmsError = (float)std::sqrt(sumError2 / result.samples.size());
+		}
+		return result;
+	}
+
+	void saveValidation(const ValidationResult& result, const std::string& outputFolderName)
+	{
+		std::string validationFilename = outputFolderName + "/Validation.csv";
+		std::ofstream validationFile(validationFilename);
+		validationFile << "Split,Index,Z given,Z calculated" << std::endl;
+		for (const ValidationSample& sample : result.samples)
+		{
+			validationFile <<
+				sample.splitIndex << "," <<
+				sample.posIndex << "," <<
+				sample.positionZ << "," <<
+				sample.positionCalc << std::endl;
+		}
+		validationFile.close();
+
+		std::string summaryFilename = outputFolderName + "/ValidationSummary.csv";
+		std::ofstream summaryFile(summaryFilename);
+		summaryFile << "Method,Tests,Mean error,RMS error,Max abs error" << std::endl;
+		summaryFile <<
+			m_validationName << "," <<
+			result.samples.size() << "," <<
+			result.meanError << "," <<
+			result.rmsError << "," <<
+			result.maxAbsError << std::endl;
+		summaryFile.close();
+
+		// Even and odd split keeps the output of calibration by half of the images
+		if (m_validationType == ValidationType::VALIDATION_EVEN_ODD)
+		{
+			std::vector<float> positionsTestZ;
+			std::vector<float> positionsCalc;
+			for (const ValidationSample& sample : result.samples)
+			{
+				positionsTestZ.push_back(sample.positionZ);
+				positionsCalc.push_back(sample.positionCalc);
+			}
+			RegressionResult identity{ 1.0F, 0.0F };
+			saveResults(positionsTestZ, positionsCalc, identity, outputFolderName, true);
+		}
+	}
+
+private:
+	// Parameters from configuration
+	ValidationType m_validationType;
+	std::string m_validationName;
+	size_t m_folds;
+	size_t m_repeats;
+	unsigned int m_seed;
+
+private:
+	void initConfig(const ConfigSnapshot& config)
+	{
+		// Get parameters from configuration
+		m_validationType	= config.focusing.validationType;
+		m_validationName	= config.focusing.validationName;
+		m_folds				= config.focusing.validationFolds;
+		m_repeats			= config.focusing.validationRepeats;
+		m_seed				= config.focusing.validationSeed;
+	}
+
+	// Test indices of each split
+	std::vector<std::vector<size_t>> makeSplits(size_t n)
+	{
+		std::vector<std::vector<size_t>> splits;
+		switch (m_validationType)
+		{
+		case ValidationType::VALIDATION_K_FOLD:
+		{
+			// Folds of shuffled indices
+			std::vector<size_t> indices = makeShuffledIndices(n, m_seed);
+			size_t folds = std::clamp(m_folds, (size_t)2, std::max(n, (size_t)2));
+			splits.resize(folds);
+			for (size_t i = 0; i < n; i++)
+			{
+				splits[i % folds].push_back(indices[i]);
+			}
+			break;
+		}
+		case ValidationType::VALIDATION_LEAVE_ONE_OUT:
+			for (size_t i = 0; i < n; i++)
+			{
+				splits.push_back({ i });
+			}
+			break;
+		case ValidationType::VALIDATION_RANDOM_SPLIT:
+			// Each repeat tests on random half of the samples
+			for (size_t repeat = 0; repeat < m_repeats; repeat++)
+			{
+				std::vector<size_t> indices = makeShuffledIndices(n, m_seed + (unsigned int)repeat);
+				indices.resize(n / 2);
+				std::sort(indices.begin(), indices.end());
+				splits.push_back(indices);
+			}
+			break;
+		default:
+		{
+			// Calibration by even images, test by odd images
+			std::vector<size_t> oddIndices;
+			for (size_t i = 1; i < n; i += 2)
+			{
+				oddIndices.push_back(i);
+			}
+			splits.push_back(oddIndices);
+			break;
+		}
+		}
+		return splits;
+	}
+
+	std::vector<size_t> makeShuffledIndices(size_t n, unsigned int seed)
+	{
+		std::vector<size_t> indices(n);
+		std::iota(indices.begin(), indices.end(), 0);
+		std::mt19937 generator(seed);
+		std::shuffle(indices.begin(), indices.end(), generator);
+		return indices;
+	}
+};
@@ -67,19 +67,44 @@ CapillaryProcessor::CapillaryProcessor()
 	m_numDescribedCappilaries = 0;
 	m_minPixelsInCappilary = 0;
 	m_surroundingPixels = 0;
+	m_pixelsInMm = 0;
+	m_rectangleSettings = RectangleSettings();
+	m_grayLevelProcessedMin = 0;
+	m_grayLevelProcessedMax = 0;
 
 	m_originalMatrix = ByteMatrix();
 	m_processedMatrix = ByteMatrix();
 	m_layerIndex = 0;
 }
 
-void CapillaryProcessor::init(Config& config)
+void CapillaryProcessor::init(const ConfigSnapshot& config)
 {
 	initConfig(config);
 }
 
-void CapillaryProcessor::describeCapillaries(Map& map, LayerInfo& layerInfo, const std::string& outputFolderName)
+void CapillaryProcessor::describeCapillaries(Map& map, LayerInfo& layerInfo, const std::string& outputFolderName,
+	JobControl& control)
 {
+	// Frames are drawn on the layer of the map
+	ByteMatrix processedMatrix = filterLayer(map, layerInfo.layerIndex);
+	Layer layer = map.getLayers()[layerInfo.layerIndex];
+	describeCapillaries(map, layerInfo, layer.matrix, processedMatrix, outputFolderName, control);
+}
+
+ByteMatrix CapillaryProcessor::filterLayer(Map& map, size_t layerIndex)
+{
+	TRACE_SCOPE("Filter layer");
+	m_layerIndex = layerIndex;
+	Layer layer = map.getLayers()[layerIndex];
+	ByteMatrix processedMatrix(layer.matrix.rows(), layer.matrix.cols());
+	performExcessFiltering(layer.matrix, processedMatrix);
+	return processedMatrix;
+}
+
+void CapillaryProcessor::describeCapillaries(Map& map, LayerInfo& layerInfo, const ByteMatrix& originalMatrix,
+	const ByteMatrix& processedMatrix, const std::string& outputFolderName, JobControl& control)
+{
+	TRACE_SCOPE("Describe layer");
 	m_layerIndex = layerInfo.layerIndex;
 
 	// Reset scores given by corner detection - new scores will be given by pixels in frame
@@ -90,18 +115,11 @@ void CapillaryProcessor::describeCapillaries(Map& map, LayerInfo& layerInfo, con
 	std::string layerFolderName = "Layer" + std::to_string(layerInfo.layerIndex + 1);
 	createFoldersIfNeed(outputFolderName, layerFolderName);
 
-	// Get pixel matrix of current layer from the map
-	Layer layer = map.getLayers()[layerInfo.layerIndex];
-	m_originalMatrix = layer.matrix;
+	// Matrices share buffers with the given ones
+	m_originalMatrix = originalMatrix;
+	m_processedMatrix = processedMatrix;
 #ifdef _DEBUG
 	cv::imwrite(outputFolderName + "/" + layerFolderName + "/Original.bmp", m_originalMatrix.asCvMatU8());
-#endif
-	// Create and fill processed matrix of current layer
-	m_processedMatrix = ByteMatrix(m_originalMatrix.rows(), m_originalMatrix.cols());
-
-	// Members passed as parameters to support filtering in chain
-	performExcessFiltering(m_originalMatrix, m_processedMatrix);
-#ifdef _DEBUG
 	cv::imwrite(outputFolderName + "/" + layerFolderName + "/Processed.bmp", m_processedMatrix.asCvMatU8());
 #endif
 	size_t numOfDescribedCapillaries = layerInfo.capillaryApexes.size();
@@ -110,9 +128,24 @@ void CapillaryProcessor::describeCapillaries(Map& map, LayerInfo& layerInfo, con
 		numOfDescribedCapillaries << " capillaries" << std::endl;
 	m_timer.start();
 
+	// Capillary is examined if at least the smallest frame by each dimension can fit in it
+	size_t minFrameWidth = m_rectangleSettings.frameSizes[0].width;
+	size_t minFrameHeight = m_rectangleSettings.frameSizes[0].height;
+	for (const FrameSize& frameSize : m_rectangleSettings.frameSizes)
+	{
+		minFrameWidth = std::min(minFrameWidth, frameSize.width);
+		minFrameHeight = std::min(minFrameHeight, frameSize.height);
+	}
+
+	// Capillaries in which frames were searched - scores of all frame sizes are written for them
+	std::vector<CapillaryInfo> searchedCapillaries;
+
 	// For each capillary in the layer: calculate and collect information about the capillary
 	for (size_t capillaryIndex = 0; capillaryIndex < numOfDescribedCapillaries; capillaryIndex++)
 	{
+		control.checkCancelled();
+		TRACE_SCOPE("Describe capillary");
+
 		// Get coordinates of detected point in the capillary
 		ScoredCorner scoredCorner = layerInfo.capillaryApexes[capillaryIndex];
 
@@ -122,8 +155,8 @@ void CapillaryProcessor::describeCapillaries(Map& map, LayerInfo& layerInfo, con
 		capillaryInfo.setPos(scoredCorner);
 
 		// Convert position of the corner from mm to pixels
-		size_t cornerRow = mm2pixels(scoredCorner.y);
-		size_t cornerCol = mm2pixels(scoredCorner.x);
+		size_t cornerRow = mm2pixels(scoredCorner.y, m_pixelsInMm);
+		size_t cornerCol = mm2pixels(scoredCorner.x, m_pixelsInMm);
 
 		// Mark pixels of the capillary and update information
 		performTraversalBFS(cornerRow, cornerCol, map, capillaryInfo);
@@ -140,7 +173,7 @@ void CapillaryProcessor::describeCapillaries(Map& map, LayerInfo& layerInfo, con
 		// Skip too low or narrow capillary
 		size_t capillaryRows = capillaryInfo.limitDn - capillaryInfo.limitUp + 1;
 		size_t capillaryCols = capillaryInfo.limitRt - capillaryInfo.limitLf + 1;
-		if ((capillaryRows < FRAME_HEIGHT) || (capillaryCols < FRAME_WIDTH))
+		if ((capillaryRows < minFrameHeight) || (capillaryCols < minFrameWidth))
 		{
 			info += " - too small";
 			std::cout << info << std::endl;
@@ -150,12 +183,28 @@ void CapillaryProcessor::describeCapillaries(Map& map, LayerInfo& layerInfo, con
 		// Instance to find inscribed rotated frame
 		MaxRectangle maxRectangleFinder(m_processedMatrix,
 			PixelPos(capillaryInfo.limitUp, capillaryInfo.limitLf),
-			capillaryRows, capillaryCols, outputFolderName + "/" + layerFolderName, capillaryIndex);
+			capillaryRows, capillaryCols, outputFolderName + "/" + layerFolderName, capillaryIndex,
+			m_rectangleSettings);
+
+		// Orientation of the capillary by its moments - used to skip brute-force search of angle
+		maxRectangleFinder.setPrincipalAxisAngle(capillaryInfo.getPrincipalAxisAngle());
 
 		// Rotated frame - is empty if cannot find rectangle with score over the threshold
 		std::vector<PixelPos> rotatedRectangle =
 			maxRectangleFinder.findRectangle(outputFolderName + "/" + layerFolderName, capillaryIndex);
 
+		// Best angle and score of each frame size - kept even if the main frame does not fit the capillary
+		std::vector<FramePlacement> framePlacements = maxRectangleFinder.getFramePlacements();
+		for (size_t sizeIndex = 0; sizeIndex < framePlacements.size(); sizeIndex++)
+		{
+			const FrameSize& frameSize = m_rectangleSettings.frameSizes[sizeIndex];
+			const FramePlacement& framePlacement = framePlacements[sizeIndex];
+			capillaryInfo.frameScores.push_back(FrameScore(frameSize.width, frameSize.height,
+				-deg2rad(framePlacement.angleDegrees),
+				100.0F * (framePlacement.score - m_rectangleSettings.scoreThreshold)));
+		}
+		searchedCapillaries.push_back(capillaryInfo);
+
 		// Skip capillary with score lower than the threshold for which no frame was found
 		if (rotatedRectangle.empty())
 		{
@@ -187,6 +236,8 @@ void CapillaryProcessor::describeCapillaries(Map& map, LayerInfo& layerInfo, con
 #ifdef _DEBUG
 	cv::imwrite(outputFolderName + "/" + layerFolderName + "/Marked.bmp", m_processedMatrix.asCvMatU8());
 #endif
+	writeFrameScores(searchedCapillaries, outputFolderName + "/" + layerFolderName);
+
 	if (layerInfo.capillariesInfo.empty())
 	{
 		std::cout << "Layer " << m_layerIndex + 1 <<
@@ -209,18 +260,34 @@ void CapillaryProcessor::describeCapillaries(Map& map, LayerInfo& layerInfo, con
 	==================================================================
 */
 
-void CapillaryProcessor::initConfig(Config& config)
+void CapillaryProcessor::initConfig(const ConfigSnapshot& config)
 {
 	// Get parameters from configuration
-	m_fineSmoothingKernelSize	= (size_t)config.getIntValue(keyFineSmoothingKernelSize);
-	m_deepSmoothingKernelSize	= (size_t)config.getIntValue(keyDeepSmoothingKernelSize);
-	m_numDescribedCappilaries	= (size_t)config.getIntValue(keyNumDescribedCappilaries);
-	m_minPixelsInCappilary		= (size_t)config.getIntValue(keyMinPixelsInCappilary);
-	m_surroundingPixels			= (size_t)config.getIntValue(keySurroundingPixels);
+	m_fineSmoothingKernelSize	= config.characterization.fineSmoothingKernelSize;
+	m_deepSmoothingKernelSize	= config.characterization.deepSmoothingKernelSize;
+	m_numDescribedCappilaries	= config.characterization.numDescribedCappilaries;
+	m_minPixelsInCappilary		= config.characterization.minPixelsInCappilary;
+	m_surroundingPixels			= config.characterization.surroundingPixels;
+	m_pixelsInMm				= config.general.pixelsInMm;
+	m_grayLevelProcessedMin		= config.characterization.grayLevelProcessedMin;
+	m_grayLevelProcessedMax		= config.characterization.grayLevelProcessedMax;
+
+	// Get parameters of search of inscribed frame
+	m_rectangleSettings.angleSearchType = config.characterization.angleSearchType;
+	m_rectangleSettings.frameSizes = config.characterization.frameSizes;
+	m_rectangleSettings.scoreThreshold = config.characterization.frameScoreThreshold;
+	m_rectangleSettings.pixelsInMm = config.general.pixelsInMm;
+}
+
+// Examine gray level to find limit of capillary - performed on processed image
+bool CapillaryProcessor::isValidGrayLevelProcessed(byte val)
+{
+	return (m_grayLevelProcessedMin <= val) && (val <= m_grayLevelProcessedMax);
 }
 
 void CapillaryProcessor::performGaussianBlur(ByteMatrix& src, ByteMatrix& dst)
 {
+	TRACE_SCOPE("Gaussian blur kernel");
 	size_t rows = src.rows();
 	size_t cols = src.cols();
 
@@ -249,6 +316,7 @@ void CapillaryProcessor::performGaussianBlur(ByteMatrix& src, ByteMatrix& dst)
 
 void CapillaryProcessor::performUniformSmoothing(ByteMatrix& src, ByteMatrix& dst)
 {
+	TRACE_SCOPE("Uniform smoothing kernel");
 	size_t rows = src.rows();
 	size_t cols = src.cols();
 
@@ -286,6 +354,7 @@ void CapillaryProcessor::performUniformSmoothing(ByteMatrix& src, ByteMatrix& ds
 
 void CapillaryProcessor::performExcessFiltering(ByteMatrix& src, ByteMatrix& dst)
 {
+	TRACE_SCOPE("Excess HPF kernel");
 	size_t rows = src.rows();
 	size_t cols = src.cols();
 
@@ -329,6 +398,7 @@ void CapillaryProcessor::performExcessFiltering(ByteMatrix& src, ByteMatrix& dst
 */
 void CapillaryProcessor::performTraversalBFS(size_t row, size_t col, Map& map, CapillaryInfo& capillaryInfo)
 {
+	TRACE_SCOPE("BFS traversal");
 	// Define queue of pixel positions for traversal by BFS algorithn
 	std::queue<PixelPos> pixels;
 
@@ -404,12 +474,20 @@ void CapillaryProcessor::processPixel(const PixelPos& pixelPos, CapillaryInfo& c
 	capillaryInfo.pixelsCapillary++;
 	capillaryInfo.energyCapillary += m_originalMatrix.get(pixelPos.pixelRow, pixelPos.pixelCol);
 
+	// Accumulate raw moments of the capillary to estimate its orientation
+	capillaryInfo.momentX += pixelPos.pixelCol;
+	capillaryInfo.momentY += pixelPos.pixelRow;
+	capillaryInfo.momentXX += pixelPos.pixelCol * pixelPos.pixelCol;
+	capillaryInfo.momentXY += pixelPos.pixelCol * pixelPos.pixelRow;
+	capillaryInfo.momentYY += pixelPos.pixelRow * pixelPos.pixelRow;
+
 	// Mark the pixel as already processed
 	m_processedMatrix.set(pixelPos.pixelRow, pixelPos.pixelCol, WHITE);
 }
 
 void CapillaryProcessor::collectSurroundings(std::vector<CapillaryInfo>& capillariesInfo)
 {
+	TRACE_SCOPE("Collect surroundings");
 	// Accumulate number of pixels and sum of gray levels in surrounding rectangles of each capillary
 	for (CapillaryInfo& capillaryInfo : capillariesInfo)
 	{
@@ -464,6 +542,7 @@ void CapillaryProcessor::updateSurroundingData(CapillaryInfo& capillaryInfo,
 void CapillaryProcessor::trimAndSetLayerScores(LayerInfo& layerInfo, float startXmm, float startYmm,
 	std::vector<CapillaryInfo>& capillariesInfo, const std::string& layerFolderName)
 {
+	TRACE_SCOPE("Trim and score layer");
 	// Sort found capillaries by score in descending order
 	std::sort(capillariesInfo.begin(), capillariesInfo.end(), [](CapillaryInfo capillaryL, CapillaryInfo capillaryR) {
 		return capillaryL.score > capillaryR.score;
@@ -496,8 +575,8 @@ void CapillaryProcessor::trimAndSetLayerScores(LayerInfo& layerInfo, float start
 
 		fileData <<
 			capillaryInfo.index + 1 << "," <<
-			std::setprecision(4) << capillaryInfo.posApex.x + startXmm << " (" << mm2pixels(capillaryInfo.posApex.x) << ")," <<
-			std::setprecision(4) << capillaryInfo.posApex.y + startYmm << " (" << mm2pixels(capillaryInfo.posApex.y) << ")," <<
+			std::setprecision(4) << capillaryInfo.posApex.x + startXmm << " (" << mm2pixels(capillaryInfo.posApex.x, m_pixelsInMm) << ")," <<
+			std::setprecision(4) << capillaryInfo.posApex.y + startYmm << " (" << mm2pixels(capillaryInfo.posApex.y, m_pixelsInMm) << ")," <<
 			std::setprecision(4) << capillaryInfo.posApex.z << "," <<
 			std::setprecision(2) << capillaryInfo.angle << "," <<
 			(int)contrast << "," <<
@@ -509,6 +588,29 @@ void CapillaryProcessor::trimAndSetLayerScores(LayerInfo& layerInfo, float start
 	fileData.close();
 }
 
+void CapillaryProcessor::writeFrameScores(const std::vector<CapillaryInfo>& capillariesInfo,
+	const std::string& layerFolderName)
+{
+	std::string filenameFrames = layerFolderName + "/FrameScores.csv";
+	std::ofstream fileFrames(filenameFrames);
+	fileFrames << "Num,Width,Height,Angle rad,Score" << std::endl;
+
+	for (const CapillaryInfo& capillaryInfo : capillariesInfo)
+	{
+		for (const FrameScore& frameScore : capillaryInfo.frameScores)
+		{
+			fileFrames <<
+				capillaryInfo.index + 1 << "," <<
+				frameScore.width << "," <<
+				frameScore.height << "," <<
+				std::setprecision(2) << frameScore.angle << "," <<
+				std::setprecision(2) << frameScore.score << std::endl;
+		}
+	}
+
+	fileFrames.close();
+}
+
 void CapillaryProcessor::drawRotatedFrame(const std::vector<PixelPos>& rotatedFrame)
 {
 	drawLine(rotatedFrame[0], rotatedFrame[1]);
@@ -7,8 +7,16 @@ class CapillaryProcessor
 {
 public:
 	CapillaryProcessor();
-	void init(Config& config);
-	void describeCapillaries(Map& map, LayerInfo& layerInfo, const std::string& outputFolderName);
+	void init(const ConfigSnapshot& config);
+	void describeCapillaries(Map& map, LayerInfo& layerInfo, const std::string& outputFolderName,
+		JobControl& control);
+
+	// Excess HPF of the layer
+	ByteMatrix filterLayer(Map& map, size_t layerIndex);
+
+	// Pixels of capillaries are marked in the given processed matrix and frames are drawn on the original one
+	void describeCapillaries(Map& map, LayerInfo& layerInfo, const ByteMatrix& originalMatrix,
+		const ByteMatrix& processedMatrix, const std::string& outputFolderName, JobControl& control);
 
 private:
 	// Kernels to process image - used also to skip unwanted pixels on seams
@@ -18,6 +26,12 @@ private:
 	size_t m_numDescribedCappilaries;
 	size_t m_minPixelsInCappilary;
 	size_t m_surroundingPixels;
+	size_t m_pixelsInMm;
+	RectangleSettings m_rectangleSettings;
+
+	// Valid gray levels of processed pixels in capillaries
+	byte m_grayLevelProcessedMin;
+	byte m_grayLevelProcessedMax;
 
 	ByteMatrix m_originalMatrix;
 	ByteMatrix m_processedMatrix;
@@ -25,7 +39,8 @@ private:
 	Timer m_timer;
 
 private:
-	void initConfig(Config& config);
+	void initConfig(const ConfigSnapshot& config);
+	bool isValidGrayLevelProcessed(byte val);
 	void performGaussianBlur(ByteMatrix& src, ByteMatrix& dst);
 	void performUniformSmoothing(ByteMatrix& src, ByteMatrix& dst);
 	void performExcessFiltering(ByteMatrix& src, ByteMatrix& dst);
@@ -43,6 +58,7 @@ private:
 	void collectSurroundings(std::vector<CapillaryInfo>& capillariesInfo);
 	void updateSurroundingData(CapillaryInfo& capillaryInfo,
 		size_t rectUp, size_t rectDn, size_t rectLf, size_t rectRt);
+	void writeFrameScores(const std::vector<CapillaryInfo>& capillariesInfo, const std::string& layerFolderName);
 	void trimAndSetLayerScores(LayerInfo& layerInfo, float startXmm, float startYmm,
 		std::vector<CapillaryInfo>& capillariesInfo, const std::string& layerFolderName);
 	void drawRotatedFrame(const std::vector<PixelPos>& rotatedFrame);
@@ -0,0 +1,109 @@
+#include "CapillaryRotator.h"
+
+CapillaryRotator::CapillaryRotator()
+{
+	m_srcMatrix = ByteMatrix();
+}
+
+CapillaryRotator::CapillaryRotator(ByteMatrix& srcMatrix)
+{
+	m_srcMatrix = srcMatrix;
+}
+
+RotationLimits CapillaryRotator::rotate(size_t angleDegrees, BitMatrix& dstMask)
+{
+	const TrigTable& trigTable = getTrigTable();
+	float cosAngle = trigTable.cosValues[angleDegrees % FULL_CIRCLE_DEGREES];
+	float sinAngle = trigTable.sinValues[angleDegrees % FULL_CIRCLE_DEGREES];
+
+	// Sizes of source and destination
+	int rowsSrc = (int)m_srcMatrix.rows();
+	int colsSrc = (int)m_srcMatrix.cols();
+	int rowsDst = (int)dstMask.rows();
+	int colsDst = (int)dstMask.cols();
+
+	// Centers of source and destination
+	int centerRowSrc = rowsSrc / 2;
+	int centerColSrc = colsSrc / 2;
+	int centerRowDst = rowsDst / 2;
+	int centerColDst = colsDst / 2;
+
+	// Reset background of rotated capillary
+	dstMask.clean();
+
+	// Bounding box of rotated source corners relative to destination center
+	float cornersX[] = { (float)-centerColSrc, (float)(colsSrc - 1 - centerColSrc) };
+	float cornersY[] = { (float)-centerRowSrc, (float)(rowsSrc - 1 - centerRowSrc) };
+	float minX = 0.0F;
+	float maxX = 0.0F;
+	float minY = 0.0F;
+	float maxY = 0.0F;
+	for (float cornerX : cornersX)
+	{
+		for (float cornerY : cornersY)
+		{
+			float rotatedX = cornerX * cosAngle - cornerY * sinAngle;
+			float rotatedY = cornerX * sinAngle + cornerY * cosAngle;
+			minX = std::min(minX, rotatedX);
+			maxX = std::max(maxX, rotatedX);
+			minY = std::min(minY, rotatedY);
+			maxY = std::max(maxY, rotatedY);
+		}
+	}
+
+	// Bounding box in destination extended by one pixel for rounding and trimmed by destination size
+	int rowBegin = std::max(centerRowDst + (int)std::floor(minY) - 1, 0);
+	int rowEnd = std::min(centerRowDst + (int)std::ceil(maxY) + 1, rowsDst - 1);
+	int colBegin = std::max(centerColDst + (int)std::floor(minX) - 1, 0);
+	int colEnd = std::min(centerColDst + (int)std::ceil(maxX) + 1, colsDst - 1);
+
+	RotationLimits limits;
+	limits.limitUp = (size_t)rowsDst;
+	limits.limitLf = (size_t)colsDst;
+
+	const byte* srcBuffer = m_srcMatrix.getBuffer();
+	for (int row = rowBegin; row <= rowEnd; row++)
+	{
+		// Source position of the first pixel in the row - shifted by half pixel to round by truncation
+		float deltaX = (float)(colBegin - centerColDst);
+		float deltaY = (float)(row - centerRowDst);
+		float srcCol = (float)centerColSrc + deltaX * cosAngle + deltaY * sinAngle + 0.5F;
+		float srcRow = (float)centerRowSrc - deltaX * sinAngle + deltaY * cosAngle + 0.5F;
+
+		word* dstRow = dstMask.getRow((size_t)row);
+		for (int col = colBegin; col <= colEnd; col++, srcCol += cosAngle, srcRow -= sinAngle)
+		{
+			// Skip positions out of source
+			if ((srcCol < 0.0F) || (srcRow < 0.0F) || (srcCol >= (float)colsSrc) || (srcRow >= (float)rowsSrc))
+			{
+				continue;
+			}
+
+			// Only white pixels of the capillary are rotated
+			if (srcBuffer[(size_t)srcRow * colsSrc + (size_t)srcCol] != WHITE)
+			{
+				continue;
+			}
+
+			dstRow[col / BITS_IN_WORD] |= (word)1 << (col % BITS_IN_WORD);
+
+			// Rows are iterated in ascending order: upper limit is set once, lower limit is the last one
+			if (!limits.found)
+			{
+				limits.limitUp = (size_t)row;
+				limits.found = true;
+			}
+			limits.limitDn = (size_t)row;
+			limits.limitLf = std::min(limits.limitLf, (size_t)col);
+			limits.limitRt = std::max(limits.limitRt, (size_t)col);
+		}
+	}
+
+	return limits;
+}
+
+const TrigTable& CapillaryRotator::getTrigTable()
+{
+	static const TrigTable trigTable;
+	return trigTable;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+
+#include "BitMatrix.h"
+
+const size_t FULL_CIRCLE_DEGREES = 360;
+
+// Cosine and sine of each whole angle in degrees - calculated once for all rotations
+class TrigTable
+{
+public:
+	float cosValues[FULL_CIRCLE_DEGREES];
+	float sinValues[FULL_CIRCLE_DEGREES];
+
+public:
+	TrigTable()
+	{
+		for (size_t angleDegrees = 0; angleDegrees < FULL_CIRCLE_DEGREES; angleDegrees++)
+		{
+			float angle = deg2rad(angleDegrees);
+			cosValues[angleDegrees] = std::cosf(angle);
+			sinValues[angleDegrees] = std::sinf(angle);
+		}
+	}
+};
+
+// Limits of white pixels in the rotated capillary - recorded during the rotation itself
+class RotationLimits
+{
+public:
+	size_t limitUp;
+	size_t limitDn;
+	size_t limitLf;
+	size_t limitRt;
+	bool found;
+
+public:
+	RotationLimits()
+	{
+		limitUp = 0;
+		limitDn = 0;
+		limitLf = 0;
+		limitRt = 0;
+		found = false;
+	}
+};
+
+/*
+	Rotate white pixels of the capillary around its center into the bit mask by inverse mapping:
+	each destination pixel in the bounding box of the rotated capillary takes the nearest source pixel.
+	Source position is advanced along the destination row by the constant affine step,
+	so no trigonometric functions and no holes appear inside the rotated capillary.
+*/
+class CapillaryRotator
+{
+public:
+	CapillaryRotator();
+	CapillaryRotator(ByteMatrix& srcMatrix);
+	RotationLimits rotate(size_t angleDegrees, BitMatrix& dstMask);
+
+private:
+	ByteMatrix m_srcMatrix;
+
+private:
+	static const TrigTable& getTrigTable();
+};
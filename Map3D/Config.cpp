@@ -1,15 +1,28 @@
+#include <sstream>
+
 #include "Config.h"
 
 Config::Config()
 {
+	m_isSnapshotCompiled = false;
 }
 
 bool Config::load(std::string configFilename)
 {
 	boost::property_tree::xml_parser::read_xml(configFilename, m_propertyTree);
+	compileSnapshot();
 	return true;
 }
 
+const ConfigSnapshot& Config::getSnapshot()
+{
+	if (!m_isSnapshotCompiled)
+	{
+		compileSnapshot();
+	}
+	return m_snapshot;
+}
+
 int Config::getIntValue(const std::string& key)
 {
 	if (m_overrides.contains(key))
@@ -40,14 +53,208 @@ std::string Config::getStringValue(const std::string& key)
 void Config::setOverride(const std::string& key, int val)
 {
 	m_overrides[key] = std::to_string(val);
+	m_isSnapshotCompiled = false;
 }
 
 void Config::setOverride(const std::string& key, float val)
 {
 	m_overrides[key] = std::to_string(val);
+	m_isSnapshotCompiled = false;
 }
 
 void Config::setOverride(const std::string& key, const std::string& val)
 {
 	m_overrides[key] = val;
+	m_isSnapshotCompiled = false;
+}
+
+void Config::compileSnapshot()
+{
+	ConfigSnapshot snapshot;
+
+	snapshot.general.pixelsInMm = getSizeValue(keyPixelsInMm, 1);
+
+	snapshot.folders.inputMap	= getStringValue(keyInputMapFolder);
+	snapshot.folders.inputLock	= getStringValue(keyInputLockFolder);
+	snapshot.folders.outputMap	= getStringValue(keyOutputMapFolder);
+	snapshot.folders.outputLock	= getStringValue(keyOutputLockFolder);
+
+	ConfigSnapshot::Stitching& stitching = snapshot.stitching;
+	stitching.scanPosFilename		= getStringValue(keyScanPosFilename);
+	stitching.markerCornerSize		= getSizeValue(keyMarkerCornerSize, 1);
+	stitching.imageBiasPixelsX		= getSizeValue(keyImageBiasPixelsX, 0);
+	stitching.imageBiasPixelsY		= getSizeValue(keyImageBiasPixelsY, 0);
+	stitching.imageMarginRelativeX	= getFloatValue(keyImageMarginRelX);
+	stitching.imageMarginRelativeY	= getFloatValue(keyImageMarginRelY);
+	stitching.imageFrameRelativeW	= getFloatValue(keyImageFrameRelW);
+	stitching.imageFrameRelativeH	= getFloatValue(keyImageFrameRelH);
+	stitching.toleranceZ			= getFloatValue(keyToleranceZ);
+	if (stitching.toleranceZ < 0.0F)
+	{
+		throw std::exception("Tolerance of Z positions must not be negative");
+	}
+
+	ConfigSnapshot::Identification& identification = snapshot.identification;
+	identification.croppedRows				= getSizeValue(keyCroppedRows, 0);
+	identification.grayLevelOriginalMin		= getByteValue(keyGrayLevelOriginalMin);
+	identification.grayLevelOriginalMax		= getByteValue(keyGrayLevelOriginalMax);
+	identification.gradientThreshold		= getByteValue(keyGradientThreshold);
+	identification.minDistancePixels		= getSizeValue(keyMinDistancePixels, 0);
+	identification.minFoundCapillaries		= getSizeValue(keyMinFoundCapillaries, 0);
+	if (identification.grayLevelOriginalMin > identification.grayLevelOriginalMax)
+	{
+		throw std::exception("Original gray level range is empty");
+	}
+
+	ConfigSnapshot::Characterization& characterization = snapshot.characterization;
+	characterization.fineSmoothingKernelSize	= getSizeValue(keyFineSmoothingKernelSize, 1);
+	characterization.deepSmoothingKernelSize	= getSizeValue(keyDeepSmoothingKernelSize, 1);
+	characterization.grayLevelProcessedMin		= getByteValue(keyGrayLevelProcessedMin);
+	characterization.grayLevelProcessedMax		= getByteValue(keyGrayLevelProcessedMax);
+	characterization.numDescribedCappilaries	= getSizeValue(keyNumDescribedCappilaries, 0);
+	characterization.minPixelsInCappilary		= getSizeValue(keyMinPixelsInCappilary, 0);
+	characterization.surroundingPixels			= getSizeValue(keySurroundingPixels, 0);
+	characterization.angleSearchType			= (AngleSearchType)getOptionIndex(keyAngleSearch,
+		{ "Sequential", "CoarseToFine", "Moments" });
+	characterization.frameSizes					= parseFrameSizes(getStringValue(keyFrameSizes));
+	characterization.frameScoreThreshold		= getFloatValue(keyFrameScoreThreshold);
+	if (characterization.grayLevelProcessedMin > characterization.grayLevelProcessedMax)
+	{
+		throw std::exception("Processed gray level range is empty");
+	}
+
+	ConfigSnapshot::Focusing& focusing = snapshot.focusing;
+	focusing.zPosFilename				= getStringValue(keyZPosFilename);
+	focusing.sequenceCacheMegabytes		= getSizeValue(keySequenceCacheMegabytes, 0);
+
+	std::string focusingMethod = getStringValue(keyFocusingMethod);
+	focusing.isCompareMethod = focusingMethod == "Compare";
+	focusing.metricType = focusing.isCompareMethod ? FocusMetricType::METRIC_MODE : getMetricType(focusingMethod);
+	focusing.compareMetrics = parseMetricTypes(getStringValue(keyFocusMetrics));
+
+	focusing.histogramOutputType		= (HistogramOutputType)getOptionIndex(keyHistogramOutput,
+		{ "None", "PerFrame", "Batched" });
+	focusing.modeImagePartCenter		= getSizeValue(keyModeImagePartCenter, 1);
+	focusing.varianceImagePartCenter	= getSizeValue(keyVarianceImagePartCenter, 1);
+	focusing.gradientImagePartCenter	= getSizeValue(keyGradientImagePartCenter, 1);
+
+	focusing.validationName				= getStringValue(keyValidationMethod);
+	focusing.validationType				= (ValidationType)getOptionIndex(keyValidationMethod,
+		{ "EvenOdd", "KFold", "LeaveOneOut", "RandomSplit" });
+	focusing.validationFolds			= getSizeValue(keyValidationFolds, 2);
+	focusing.validationRepeats			= getSizeValue(keyValidationRepeats, 1);
+	focusing.validationSeed				= (unsigned int)getSizeValue(keyValidationSeed, 0);
+
+	focusing.lockCalibrationType		= (CalibrationType)getOptionIndex(keyLockCalibration,
+		{ "Regression", "Table" });
+	focusing.lockLatencyWindow			= getSizeValue(keyLockLatencyWindow, 0);
+
+	focusing.spectrumSizeFFT			= getSizeValue(keySpectrumSizeFFT, 2);
+	focusing.spectrumSizeEnergy			= getSizeValue(keySpectrumSizeEnergy, 1);
+	focusing.spectrumNormalization		= (double)getFloatValue(keySpectrumNormalization);
+	focusing.isSpectrumBitmapOutput		= getOptionIndex(keySpectrumOutput, { "EnergyOnly", "Bitmaps" }) == 1;
+	if ((focusing.spectrumSizeFFT & (focusing.spectrumSizeFFT - 1)) != 0)
+	{
+		throw std::exception("Size of FFT must be power of two");
+	}
+	if (focusing.spectrumNormalization <= 0.0)
+	{
+		throw std::exception("Normalization of spectrum must be positive");
+	}
+
+	m_snapshot = snapshot;
+	m_isSnapshotCompiled = true;
+}
+
+size_t Config::getSizeValue(const std::string& key, size_t minVal)
+{
+	int val = getIntValue(key);
+	if ((val < 0) || ((size_t)val < minVal))
+	{
+		throw std::exception(("Value is below " + std::to_string(minVal) + ": " + key).c_str());
+	}
+	return (size_t)val;
+}
+
+byte Config::getByteValue(const std::string& key)
+{
+	int val = getIntValue(key);
+	if ((val < 0) || (val > 255))
+	{
+		throw std::exception(("Value is out of gray levels: " + key).c_str());
+	}
+	return (byte)val;
+}
+
+// Index of the option in the list of allowed options
+size_t Config::getOptionIndex(const std::string& key, const std::vector<std::string>& options)
+{
+	std::string val = getStringValue(key);
+	for (size_t optionIndex = 0; optionIndex < options.size(); optionIndex++)
+	{
+		if (options[optionIndex] == val)
+		{
+			return optionIndex;
+		}
+	}
+	throw std::exception(("Unknown option " + val + ": " + key).c_str());
+}
+
+std::vector<FrameSize> Config::parseFrameSizes(const std::string& frameSizes)
+{
+	// Sizes are given as comma separated list of Width x Height, for example: 40x100,30x75
+	std::vector<FrameSize> parsedSizes;
+	std::istringstream sizesStream(frameSizes);
+	std::string frameSize;
+	while (std::getline(sizesStream, frameSize, ','))
+	{
+		size_t delimPos = frameSize.find('x');
+		if (delimPos == std::string::npos)
+		{
+			throw std::exception(("Invalid frame size: " + frameSize).c_str());
+		}
+		size_t width = (size_t)std::stoi(frameSize.substr(0, delimPos));
+		size_t height = (size_t)std::stoi(frameSize.substr(delimPos + 1));
+		if ((width == 0) || (height == 0))
+		{
+			throw std::exception(("Invalid frame size: " + frameSize).c_str());
+		}
+		parsedSizes.push_back(FrameSize(width, height));
+	}
+
+	if (parsedSizes.empty())
+	{
+		throw std::exception("No frame sizes are given");
+	}
+	return parsedSizes;
+}
+
+FocusMetricType Config::getMetricType(const std::string& metricName)
+{
+	for (size_t metricIndex = 0; metricIndex < FocusMetricType::METRICS_NUM; metricIndex++)
+	{
+		if (focusMetricNames[metricIndex] == metricName)
+		{
+			return (FocusMetricType)metricIndex;
+		}
+	}
+	throw std::exception(("Unknown focus metric: " + metricName).c_str());
+}
+
+// Metrics are given as comma separated list of names, for example: Mode,Tenengrad
+std::vector<FocusMetricType> Config::parseMetricTypes(const std::string& metricNames)
+{
+	std::vector<FocusMetricType> metricTypes;
+	std::istringstream namesStream(metricNames);
+	std::string metricName;
+	while (std::getline(namesStream, metricName, ','))
+	{
+		metricTypes.push_back(getMetricType(metricName));
+	}
+
+	if (metricTypes.empty())
+	{
+		throw std::exception("No focus metrics are given");
+	}
+	return metricTypes;
 }
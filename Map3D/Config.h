@@ -5,6 +5,8 @@
 #include <string>
 #include <map>
 
+#include "ConfigSnapshot.h"
+
 const std::string keyPixelsInMm					= "HemoScope.General.PixelsInMm";
 const std::string keyInputMapFolder				= "HemoScope.Input.Map.Folder";
 const std::string keyInputLockFolder			= "HemoScope.Input.Lock.Folder";
@@ -18,6 +20,7 @@ const std::string keyImageMarginRelX			= "HemoScope.Procedures.Stitching.Image.M
 const std::string keyImageMarginRelY			= "HemoScope.Procedures.Stitching.Image.MarginRelative.Y";
 const std::string keyImageFrameRelW				= "HemoScope.Procedures.Stitching.Image.FrameRelative.Width";
 const std::string keyImageFrameRelH				= "HemoScope.Procedures.Stitching.Image.FrameRelative.Height";
+const std::string keyToleranceZ					= "HemoScope.Procedures.Stitching.ToleranceZ";
 const std::string keyCroppedRows				= "HemoScope.Procedures.Identification.CroppedRows";
 const std::string keyGrayLevelOriginalMin		= "HemoScope.Procedures.Identification.GrayLevelOriginal.Min";
 const std::string keyGrayLevelOriginalMax		= "HemoScope.Procedures.Identification.GrayLevelOriginal.Max";
@@ -31,20 +34,39 @@ const std::string keyGrayLevelProcessedMax		= "HemoScope.Procedures.Characteriza
 const std::string keyNumDescribedCappilaries	= "HemoScope.Procedures.Characterization.NumDescribedCappilaries";
 const std::string keyMinPixelsInCappilary		= "HemoScope.Procedures.Characterization.MinPixelsInCappilary";
 const std::string keySurroundingPixels			= "HemoScope.Procedures.Characterization.SurroundingPixels";
+const std::string keyAngleSearch				= "HemoScope.Procedures.Characterization.AngleSearch";
+const std::string keyFrameSizes					= "HemoScope.Procedures.Characterization.Frame.Sizes";
+const std::string keyFrameScoreThreshold		= "HemoScope.Procedures.Characterization.Frame.ScoreThreshold";
 const std::string keyZPosFilename				= "HemoScope.Procedures.Focusing.ZPosFile";
 const std::string keyFocusingMethod				= "HemoScope.Procedures.Focusing.Method";
+const std::string keySequenceCacheMegabytes		= "HemoScope.Procedures.Focusing.Sequence.CacheMegabytes";
+const std::string keyHistogramOutput			= "HemoScope.Procedures.Focusing.Histogram.Output";
 const std::string keyModeImagePartCenter		= "HemoScope.Procedures.Focusing.Mode.ImagePartCenter";
 const std::string keyVarianceImagePartCenter	= "HemoScope.Procedures.Focusing.Variance.ImagePartCenter";
+const std::string keyFocusMetrics				= "HemoScope.Procedures.Focusing.Compare.Metrics";
+const std::string keyGradientImagePartCenter	= "HemoScope.Procedures.Focusing.Gradient.ImagePartCenter";
+const std::string keyValidationMethod			= "HemoScope.Procedures.Focusing.Validation.Method";
+const std::string keyValidationFolds			= "HemoScope.Procedures.Focusing.Validation.Folds";
+const std::string keyValidationRepeats			= "HemoScope.Procedures.Focusing.Validation.Repeats";
+const std::string keyValidationSeed				= "HemoScope.Procedures.Focusing.Validation.Seed";
+const std::string keyLockCalibration			= "HemoScope.Procedures.Focusing.Lock.Calibration";
+const std::string keyLockLatencyWindow			= "HemoScope.Procedures.Focusing.Lock.LatencyWindow";
 const std::string keySpectrumSizeFFT			= "HemoScope.Procedures.Focusing.Spectrum.SizeFFT";
 const std::string keySpectrumSizeEnergy			= "HemoScope.Procedures.Focusing.Spectrum.SizeEnergy";
 const std::string keySpectrumNormalization		= "HemoScope.Procedures.Focusing.Spectrum.Normalization";
+const std::string keySpectrumOutput				= "HemoScope.Procedures.Focusing.Spectrum.Output";
 
 class Config
 {
 public:
 	Config();
+
+	// Snapshot is compiled on load, so invalid configuration fails here
 	bool load(std::string configFilename);
 
+	// Snapshot is compiled again only if overrides are changed after the last compilation
+	const ConfigSnapshot& getSnapshot();
+
 	int getIntValue(const std::string& key);
 	float getFloatValue(const std::string& key);
 	std::string getStringValue(const std::string& key);
@@ -56,4 +78,15 @@ public:
 private:
 	boost::property_tree::ptree m_propertyTree;
 	std::map<std::string, std::string> m_overrides;
+	ConfigSnapshot m_snapshot;
+	bool m_isSnapshotCompiled;
+
+private:
+	void compileSnapshot();
+	size_t getSizeValue(const std::string& key, size_t minVal);
+	byte getByteValue(const std::string& key);
+	size_t getOptionIndex(const std::string& key, const std::vector<std::string>& options);
+	static std::vector<FrameSize> parseFrameSizes(const std::string& frameSizes);
+	static FocusMetricType getMetricType(const std::string& metricName);
+	static std::vector<FocusMetricType> parseMetricTypes(const std::string& metricNames);
 };
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+typedef unsigned char byte;
+
+enum AngleSearchType
+{
+	SEQUENTIAL,
+	COARSE_TO_FINE,
+	MOMENTS
+};
+
+enum FocusMetricType
+{
+	METRIC_MODE,
+	METRIC_VARIANCE,
+	METRIC_SPECTRUM,
+	METRIC_TENENGRAD,
+	METRIC_LAPLACIAN,
+	METRIC_BRENNER,
+	METRICS_NUM
+};
+
+const std::string focusMetricNames[FocusMetricType::METRICS_NUM] =
+{
+	"Mode",
+	"Variance",
+	"Spectrum",
+	"Tenengrad",
+	"Laplacian",
+	"Brenner"
+};
+
+enum HistogramOutputType
+{
+	HISTOGRAM_NONE,
+	HISTOGRAM_PER_FRAME,
+	HISTOGRAM_BATCHED
+};
+
+enum ValidationType
+{
+	VALIDATION_EVEN_ODD,
+	VALIDATION_K_FOLD,
+	VALIDATION_LEAVE_ONE_OUT,
+	VALIDATION_RANDOM_SPLIT
+};
+
+enum CalibrationType
+{
+	CALIBRATION_REGRESSION,
+	CALIBRATION_TABLE
+};
+
+class FrameSize
+{
+public:
+	size_t width;
+	size_t height;
+
+public:
+	FrameSize()
+	{
+		width = 0;
+		height = 0;
+	}
+
+	FrameSize(size_t frameWidth, size_t frameHeight)
+	{
+		width = frameWidth;
+		height = frameHeight;
+	}
+};
+
+// Typed parameters of the configuration with overrides applied: validated once when compiled by Config,
+// then passed to the stages by const reference, so the stages do not look up and parse the keys
+struct ConfigSnapshot
+{
+	struct General
+	{
+		size_t pixelsInMm = 0;
+	} general;
+
+	struct Folders
+	{
+		std::string inputMap;
+		std::string inputLock;
+		std::string outputMap;
+		std::string outputLock;
+	} folders;
+
+	struct Stitching
+	{
+		std::string scanPosFilename;
+		size_t markerCornerSize = 0;
+		size_t imageBiasPixelsX = 0;
+		size_t imageBiasPixelsY = 0;
+		float imageMarginRelativeX = 0.0F;
+		float imageMarginRelativeY = 0.0F;
+		float imageFrameRelativeW = 0.0F;
+		float imageFrameRelativeH = 0.0F;
+		float toleranceZ = 0.0F;
+	} stitching;
+
+	struct Identification
+	{
+		size_t croppedRows = 0;
+		byte grayLevelOriginalMin = 0;
+		byte grayLevelOriginalMax = 0;
+		byte gradientThreshold = 0;
+		size_t minDistancePixels = 0;
+		size_t minFoundCapillaries = 0;
+	} identification;
+
+	struct Characterization
+	{
+		size_t fineSmoothingKernelSize = 0;
+		size_t deepSmoothingKernelSize = 0;
+		byte grayLevelProcessedMin = 0;
+		byte grayLevelProcessedMax = 0;
+		size_t numDescribedCappilaries = 0;
+		size_t minPixelsInCappilary = 0;
+		size_t surroundingPixels = 0;
+		AngleSearchType angleSearchType = AngleSearchType::SEQUENTIAL;
+		std::vector<FrameSize> frameSizes;
+		float frameScoreThreshold = 0.0F;
+	} characterization;
+
+	struct Focusing
+	{
+		std::string zPosFilename;
+		size_t sequenceCacheMegabytes = 0;
+
+		// Single metric of the method, or all compared metrics if the method is Compare
+		bool isCompareMethod = false;
+		FocusMetricType metricType = FocusMetricType::METRIC_MODE;
+		std::vector<FocusMetricType> compareMetrics;
+
+		HistogramOutputType histogramOutputType = HistogramOutputType::HISTOGRAM_NONE;
+		size_t modeImagePartCenter = 0;
+		size_t varianceImagePartCenter = 0;
+		size_t gradientImagePartCenter = 0;
+
+		ValidationType validationType = ValidationType::VALIDATION_EVEN_ODD;
+		std::string validationName;
+		size_t validationFolds = 0;
+		size_t validationRepeats = 0;
+		unsigned int validationSeed = 0;
+
+		CalibrationType lockCalibrationType = CalibrationType::CALIBRATION_REGRESSION;
+		size_t lockLatencyWindow = 0;
+
+		size_t spectrumSizeFFT = 0;
+		size_t spectrumSizeEnergy = 0;
+		double spectrumNormalization = 0.0;
+		bool isSpectrumBitmapOutput = false;
+	} focusing;
+};
@@ -102,13 +102,16 @@ __global__ void combineSobelFilters(byte* d_srcMatrixGx, byte* d_srcMatrixGy,
 CornerDetector::CornerDetector()
 {
 	m_z = 0.0F;
+	m_pixelsInMm = 0;
 	m_croppedRows = 0;
 	m_gradientThreshold = 0;
+	m_grayLevelOriginalMin = 0;
+	m_grayLevelOriginalMax = 0;
 	m_minDistancePixels = 0;
 	m_minFoundCapillaries = 0;
 }
 
-void CornerDetector::init(Config& config)
+void CornerDetector::init(const ConfigSnapshot& config)
 {
 	initConfig(config);
 }
@@ -124,17 +127,11 @@ size_t CornerDetector::getMinFoundCapillaries()
 }
 
 /*
-	Apply Gx and Gy Sobel kernels and find average gradient values over predefined threshold
+	Apply Gx and Gy Sobel kernels and combine them into the gradient matrix
 */
-std::vector<ScoredCorner> CornerDetector::getCornersSobel(Map& map, ByteMatrix& matrix,
-	const std::string& capillariesFolderName, size_t layerIndex)
+ByteMatrix CornerDetector::calculateGradient(ByteMatrix& matrix)
 {
-	// Number of pixels around the central pixel for valid kernel odd sizes: 3, 5, 7
-	size_t halfKernelSize = CORNER_DETECTION_KERNEL_SIZE / 2;
-
-	// Filled and returned detected corners
-	std::vector<ScoredCorner> scoredCorners;
-
+	TRACE_SCOPE("Sobel kernels");
 	int rows = (int)matrix.rows();
 	int cols = (int)matrix.cols();
 
@@ -168,6 +165,26 @@ std::vector<ScoredCorner> CornerDetector::getCornersSobel(Map& map, ByteMatrix&
 	checkCuda(cudaMemcpy(gradient.getBuffer(), d_dstBufferSobel, rows * cols, cudaMemcpyDeviceToHost));
 	checkCuda(cudaDeviceSynchronize());
 
+	checkCuda(cudaFree(d_srcBuffer));
+	checkCuda(cudaFree(d_dstBufferSobelGx));
+	checkCuda(cudaFree(d_dstBufferSobelGy));
+	checkCuda(cudaFree(d_dstBufferSobel));
+	return gradient;
+}
+
+std::vector<ScoredCorner> CornerDetector::findCorners(Map& map, ByteMatrix& matrix, ByteMatrix& gradient,
+	const std::string& capillariesFolderName, size_t layerIndex)
+{
+	TRACE_SCOPE("Find corners");
+	// Number of pixels around the central pixel for valid kernel odd sizes: 3, 5, 7
+	size_t halfKernelSize = CORNER_DETECTION_KERNEL_SIZE / 2;
+
+	// Filled and returned detected corners
+	std::vector<ScoredCorner> scoredCorners;
+
+	size_t rows = matrix.rows();
+	size_t cols = matrix.cols();
+
 	for (size_t row = halfKernelSize; row < rows - m_croppedRows - halfKernelSize; row++)
 	{
 		for (size_t col = halfKernelSize; col < cols - halfKernelSize; col++)
@@ -208,8 +225,8 @@ std::vector<ScoredCorner> CornerDetector::getCornersSobel(Map& map, ByteMatrix&
 			size_t cornerIndex = 0;
 			for (; cornerIndex < scoredCorners.size(); cornerIndex++)
 			{
-				int distPixelsX = (int)mm2pixels(scoredCorners[cornerIndex].x) - (int)col;
-				int distPixelsY = (int)mm2pixels(scoredCorners[cornerIndex].y) - (int)row;
+				int distPixelsX = (int)mm2pixels(scoredCorners[cornerIndex].x, m_pixelsInMm) - (int)col;
+				int distPixelsY = (int)mm2pixels(scoredCorners[cornerIndex].y, m_pixelsInMm) - (int)row;
 				size_t distPixels2 = (size_t)(distPixelsX * distPixelsX + distPixelsY * distPixelsY);
 				if (distPixels2 < m_minDistancePixels * m_minDistancePixels)
 				{
@@ -219,8 +236,8 @@ std::vector<ScoredCorner> CornerDetector::getCornersSobel(Map& map, ByteMatrix&
 			}
 
 			// Parameters of overwritten near corner (if found) or accumulated corner
-			float x = pixels2mm(col);
-			float y = pixels2mm(row);
+			float x = pixels2mm(col, m_pixelsInMm);
+			float y = pixels2mm(row, m_pixelsInMm);
 			float nomalizedScore = 100.0F * ((float)avgGrad / m_gradientThreshold - 1.0F);
 
 			if (nearCornerFound)
@@ -248,11 +265,6 @@ std::vector<ScoredCorner> CornerDetector::getCornersSobel(Map& map, ByteMatrix&
 		return cornerL.score > cornerR.score;
 	});
 
-	checkCuda(cudaFree(d_srcBuffer));
-	checkCuda(cudaFree(d_dstBufferSobelGx));
-	checkCuda(cudaFree(d_dstBufferSobelGy));
-	checkCuda(cudaFree(d_dstBufferSobel));
-
 #ifdef _DEBUG
 	std::string filenameGradient = capillariesFolderName + "/Gradient" + std::to_string(layerIndex + 1) + ".bmp";
 	cv::imwrite(filenameGradient, gradient.asCvMatU8());
@@ -267,13 +279,22 @@ std::vector<ScoredCorner> CornerDetector::getCornersSobel(Map& map, ByteMatrix&
 	==================================================================
 */
 
-void CornerDetector::initConfig(Config& config)
+void CornerDetector::initConfig(const ConfigSnapshot& config)
 {
 	// Get parameters from configuration
-	m_croppedRows			= (size_t)config.getIntValue(keyCroppedRows);
-	m_gradientThreshold		= (byte)config.getIntValue(keyGradientThreshold);
-	m_minDistancePixels		= (size_t)config.getIntValue(keyMinDistancePixels);
-	m_minFoundCapillaries	= (size_t)config.getIntValue(keyMinFoundCapillaries);
+	m_pixelsInMm			= config.general.pixelsInMm;
+	m_croppedRows			= config.identification.croppedRows;
+	m_gradientThreshold		= config.identification.gradientThreshold;
+	m_grayLevelOriginalMin	= config.identification.grayLevelOriginalMin;
+	m_grayLevelOriginalMax	= config.identification.grayLevelOriginalMax;
+	m_minDistancePixels		= config.identification.minDistancePixels;
+	m_minFoundCapillaries	= config.identification.minFoundCapillaries;
+}
+
+// Examine gray level to find possible capillary corner - performed on raw image
+bool CornerDetector::isValidGrayLevelOriginal(byte val)
+{
+	return (m_grayLevelOriginalMin <= val) && (val <= m_grayLevelOriginalMax);
 }
 
 void CornerDetector::writeCorners(const std::vector<ScoredCorner>& scoredCorners, const std::string& filenameLayer)
@@ -283,8 +304,8 @@ void CornerDetector::writeCorners(const std::vector<ScoredCorner>& scoredCorners
 	size_t number = 1;
 	for (const ScoredCorner& scoredCorner : scoredCorners)
 	{
-		size_t row = mm2pixels(scoredCorner.y);
-		size_t col = mm2pixels(scoredCorner.x);
+		size_t row = mm2pixels(scoredCorner.y, m_pixelsInMm);
+		size_t col = mm2pixels(scoredCorner.x, m_pixelsInMm);
 		fileLayer <<
 			number++ << "," <<
 			row << "," <<
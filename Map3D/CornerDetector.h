@@ -7,16 +7,20 @@ class CornerDetector
 public:
 	CornerDetector();
 
-	void init(Config& config);
+	void init(const ConfigSnapshot& config);
 	void setLayerPosition(float z);
 	size_t getMinFoundCapillaries();
 
-	// Apply Gx and Gy Sobel kernels and find average gradient values over predefined threshold
-	std::vector<ScoredCorner> getCornersSobel(Map& map, ByteMatrix& matrix,
+	// Apply Gx and Gy Sobel kernels to the layer
+	ByteMatrix calculateGradient(ByteMatrix& matrix);
+
+	// Find average gradient values over predefined threshold
+	std::vector<ScoredCorner> findCorners(Map& map, ByteMatrix& matrix, ByteMatrix& gradient,
 		const std::string& capillariesFolderName, size_t layerIndex);
 
 private:
 	float m_z;
+	size_t m_pixelsInMm;
 
 	// Limit number of rows for the search of corners
 	size_t m_croppedRows;
@@ -24,6 +28,10 @@ private:
 	// Detect corners on the gradient matrix after applocation of Sobel filter
 	byte m_gradientThreshold;
 
+	// Valid gray levels of original pixels - mainly to skip flares
+	byte m_grayLevelOriginalMin;
+	byte m_grayLevelOriginalMax;
+
 	// Minimal allowed distance between detected corners
 	size_t m_minDistancePixels;
 
@@ -31,6 +39,7 @@ private:
 	size_t m_minFoundCapillaries;
 
 private:
-	void initConfig(Config& config);
+	void initConfig(const ConfigSnapshot& config);
+	bool isValidGrayLevelOriginal(byte val);
 	void writeCorners(const std::vector<ScoredCorner>& scoredCorners, const std::string& filenameLayer);
 };
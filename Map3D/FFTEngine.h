@@ -0,0 +1,286 @@
+#pragma once
+
+#include <map>
+#include <new>
+#include <mutex>
+#include <memory>
+#include <numeric>
+#include <algorithm>
+#include <vector>
+#include <complex>
+#include <numbers>
+
+#pragma warning(push)
+#pragma warning(disable: 5054)
+#include <opencv2/opencv.hpp>
+#pragma warning(pop)
+
+#include "Utils.h"
+
+typedef std::complex<float> complexf;
+
+// Alignment of FFT buffers fits cache line and any SIMD width
+const size_t FFT_ALIGNMENT = 64;
+
+template <typename T>
+class AlignedAllocator
+{
+public:
+	typedef T value_type;
+
+	AlignedAllocator() = default;
+	template <typename U> AlignedAllocator(const AlignedAllocator<U>&) {}
+
+	T* allocate(size_t n)
+	{
+		return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(FFT_ALIGNMENT)));
+	}
+
+	void deallocate(T* p, size_t)
+	{
+		::operator delete(p, std::align_val_t(FFT_ALIGNMENT));
+	}
+
+	template <typename U> bool operator==(const AlignedAllocator<U>&) const { return true; }
+	template <typename U> bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+typedef std::vector<complexf, AlignedAllocator<complexf>> ComplexBuffer;
+
+// Tables of FFT of the given size: built once per size and shared by all engines
+class FFTPlan
+{
+public:
+	explicit FFTPlan(size_t size)
+	{
+		m_size = size;
+
+		// Twiddles of the full size, sub-sizes take every 2nd, 4th etc. of them
+		m_twiddles.resize(size / 2);
+		for (size_t k = 0; k < size / 2; k++)
+		{
+			double angle = -2.0 * std::numbers::pi * k / size;
+			m_twiddles[k] = complexf((float)std::cos(angle), (float)std::sin(angle));
+		}
+
+		m_bitReversalFull = makeBitReversal(size);
+		m_bitReversalHalf = makeBitReversal(size / 2);
+	}
+
+	static const FFTPlan& getPlan(size_t size)
+	{
+		static std::mutex plansMutex;
+		static std::map<size_t, std::unique_ptr<FFTPlan>> plans;
+
+		std::lock_guard<std::mutex> lock(plansMutex);
+		std::unique_ptr<FFTPlan>& plan = plans[size];
+		if (!plan)
+		{
+			plan = std::make_unique<FFTPlan>(size);
+		}
+		return *plan;
+	}
+
+	size_t size() const
+	{
+		return m_size;
+	}
+
+	const complexf& twiddle(size_t index) const
+	{
+		return m_twiddles[index];
+	}
+
+	// Forward complex FFT in place, size of data is either the plan size or its half
+	void transform(complexf* data, size_t n) const
+	{
+		const std::vector<size_t>& bitReversal = (n == m_size) ? m_bitReversalFull : m_bitReversalHalf;
+		for (size_t i = 0; i < n; i++)
+		{
+			size_t j = bitReversal[i];
+			if (i < j)
+			{
+				std::swap(data[i], data[j]);
+			}
+		}
+
+		for (size_t half = 1; half < n; half <<= 1)
+		{
+			size_t twiddleStep = m_size / (2 * half);
+			for (size_t start = 0; start < n; start += 2 * half)
+			{
+				complexf* lower = data + start;
+				complexf* upper = data + start + half;
+				for (size_t j = 0; j < half; j++)
+				{
+					complexf product = upper[j] * m_twiddles[j * twiddleStep];
+					upper[j] = lower[j] - product;
+					lower[j] += product;
+				}
+			}
+		}
+	}
+
+private:
+	size_t m_size;
+	std::vector<complexf> m_twiddles;
+	std::vector<size_t> m_bitReversalFull;
+	std::vector<size_t> m_bitReversalHalf;
+
+private:
+	static std::vector<size_t> makeBitReversal(size_t n)
+	{
+		std::vector<size_t> bitReversal(n, 0);
+		for (size_t i = 1, j = 0; i < n; i++)
+		{
+			size_t bit = n >> 1;
+			for (; j & bit; bit >>= 1)
+			{
+				j ^= bit;
+			}
+			j ^= bit;
+			bitReversal[i] = j;
+		}
+		return bitReversal;
+	}
+};
+
+// 2D FFT of real image in the center of zero padded square: only half of spectrum is calculated and stored,
+// the other half is restored by Hermitian symmetry X[row][col] = conj(X[-row][-col])
+class FFTEngine
+{
+public:
+	FFTEngine()
+	{
+		m_plan = nullptr;
+		m_size = 0;
+		m_colsHalf = 0;
+	}
+
+	// Buffers are allocated once here, so transforms do not allocate memory
+	void init(size_t sizeFFT)
+	{
+		if ((sizeFFT < 2) || ((sizeFFT & (sizeFFT - 1)) != 0))
+		{
+			throw std::exception("Size of FFT must be power of two");
+		}
+
+		m_plan = &FFTPlan::getPlan(sizeFFT);
+		m_size = sizeFFT;
+		m_colsHalf = sizeFFT / 2 + 1;
+		m_spectrum.assign(m_size * m_colsHalf, complexf());
+		m_scratch.assign(m_size, complexf());
+		unrestrictColumns();
+	}
+
+	// Only bins of the given columns of full spectrum are valid after the following transforms
+	void restrictColumns(const std::vector<size_t>& cols)
+	{
+		m_transformedCols.clear();
+		for (size_t col : cols)
+		{
+			m_transformedCols.push_back((col < m_colsHalf) ? col : m_size - col);
+		}
+		std::sort(m_transformedCols.begin(), m_transformedCols.end());
+		m_transformedCols.erase(std::unique(m_transformedCols.begin(), m_transformedCols.end()), m_transformedCols.end());
+	}
+
+	void unrestrictColumns()
+	{
+		m_transformedCols.resize(m_colsHalf);
+		std::iota(m_transformedCols.begin(), m_transformedCols.end(), 0);
+	}
+
+	size_t getSize() const
+	{
+		return m_size;
+	}
+
+	void transform(const cv::Mat& image, size_t rowBegin, size_t colBegin)
+	{
+		size_t rows = image.rows;
+		size_t cols = image.cols;
+		if ((rowBegin + rows > m_size) || (colBegin + cols > m_size))
+		{
+			throw std::exception("Image does not fit size of FFT");
+		}
+
+		// Rows of spectrum: padding rows are zeros, image rows are transformed as real data
+		for (size_t row = 0; row < m_size; row++)
+		{
+			complexf* spectrumRow = m_spectrum.data() + row * m_colsHalf;
+			if ((row < rowBegin) || (row >= rowBegin + rows))
+			{
+				std::fill(spectrumRow, spectrumRow + m_colsHalf, complexf());
+				continue;
+			}
+			transformRealRow(image.ptr<byte>((int)(row - rowBegin)), cols, colBegin, spectrumRow);
+		}
+
+		// Columns of spectrum are gathered into contiguous scratch buffer
+		for (size_t col : m_transformedCols)
+		{
+			for (size_t row = 0; row < m_size; row++)
+			{
+				m_scratch[row] = m_spectrum[row * m_colsHalf + col];
+			}
+			m_plan->transform(m_scratch.data(), m_size);
+			for (size_t row = 0; row < m_size; row++)
+			{
+				m_spectrum[row * m_colsHalf + col] = m_scratch[row];
+			}
+		}
+	}
+
+	// Bin of full spectrum
+	complexf getBin(size_t row, size_t col) const
+	{
+		if (col < m_colsHalf)
+		{
+			return m_spectrum[row * m_colsHalf + col];
+		}
+		size_t rowMirror = (m_size - row) % m_size;
+		size_t colMirror = m_size - col;
+		return std::conj(m_spectrum[rowMirror * m_colsHalf + colMirror]);
+	}
+
+private:
+	const FFTPlan* m_plan;
+	size_t m_size;
+	size_t m_colsHalf;
+
+	// Half spectrum: rows of size / 2 + 1 bins
+	ComplexBuffer m_spectrum;
+	ComplexBuffer m_scratch;
+
+	// Columns of half spectrum transformed by column pass
+	std::vector<size_t> m_transformedCols;
+
+private:
+	// Real row of size N is packed into N / 2 complex values, transformed and split into N / 2 + 1 bins
+	void transformRealRow(const byte* pixels, size_t cols, size_t colBegin, complexf* dst)
+	{
+		size_t half = m_size / 2;
+		complexf* packed = m_scratch.data();
+		for (size_t k = 0; k < half; k++)
+		{
+			size_t colEven = 2 * k;
+			size_t colOdd = 2 * k + 1;
+			float valEven = ((colEven >= colBegin) && (colEven < colBegin + cols)) ? (float)pixels[colEven - colBegin] : 0.0F;
+			float valOdd = ((colOdd >= colBegin) && (colOdd < colBegin + cols)) ? (float)pixels[colOdd - colBegin] : 0.0F;
+			packed[k] = complexf(valEven, valOdd);
+		}
+
+		m_plan->transform(packed, half);
+
+		for (size_t k = 0; k <= half; k++)
+		{
+			complexf z = packed[k % half];
+			complexf zMirror = std::conj(packed[(half - k) % half]);
+			complexf even = 0.5F * (z + zMirror);
+			complexf odd = complexf(0.0F, -0.5F) * (z - zMirror);
+			complexf twiddle = (k < half) ? m_plan->twiddle(k) : complexf(-1.0F, 0.0F);
+			dst[k] = even + twiddle * odd;
+		}
+	}
+};
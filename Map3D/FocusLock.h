@@ -0,0 +1,254 @@
+#pragma once
+
+#include <vector>
+#include <fstream>
+#include <algorithm>
+
+#include "Timer.h"
+#include "FocusMetrics.h"
+
+#pragma warning(disable: 26812)
+
+// Latency of frame processing in milliseconds
+struct LatencyPercentiles
+{
+	size_t framesNum;
+	double p50;
+	double p90;
+	double p99;
+	double max;
+};
+
+// Image marker of calibration table and its Z position
+struct CalibrationPoint
+{
+	float marker;
+	float positionZ;
+};
+
+// Estimates Z offset frame by frame: calibration is loaded once, frames are processed without file I/O
+class FocusLock
+{
+public:
+	FocusLock()
+	{
+		m_metricType = FocusMetricType::METRIC_MODE;
+		m_calibrationType = CalibrationType::CALIBRATION_REGRESSION;
+		m_regression = RegressionResult{};
+		m_imagePartCenter = 0;
+		m_latencyWindow = 0;
+		m_latencyIndex = 0;
+		m_framesNum = 0;
+	}
+
+	void init(const ConfigSnapshot& config)
+	{
+		initConfig(config);
+		if (m_metricType == FocusMetricType::METRIC_SPECTRUM)
+		{
+			m_spectrumAnalyzer.init(config);
+		}
+
+		// All state used per frame is allocated here
+		m_latencies.assign(m_latencyWindow, 0.0);
+		m_latenciesSorted.assign(m_latencyWindow, 0.0);
+		resetLatencies();
+	}
+
+	void setCalibration(const RegressionResult& regression)
+	{
+		m_regression = regression;
+		m_calibrationTable.clear();
+		m_calibrationType = CalibrationType::CALIBRATION_REGRESSION;
+	}
+
+	// Calibration saved by calculateDepth: regression line followed by table of markers
+	void loadCalibration(const std::string& calibrationFilename)
+	{
+		std::ifstream calibrationFile(calibrationFilename);
+		if (!calibrationFile.is_open())
+		{
+			throw std::exception(("Cannot read file: " + calibrationFilename).c_str());
+		}
+
+		std::string line;
+		getline(calibrationFile, line); // header of regression
+		getline(calibrationFile, line);
+		RegressionResult regression{};
+		if (sscanf_s(line.c_str(), "%f,%f", &regression.slope, &regression.offset) != 2)
+		{
+			throw std::exception(("Wrong calibration regression: " + calibrationFilename).c_str());
+		}
+
+		std::vector<CalibrationPoint> calibrationTable;
+		getline(calibrationFile, line); // header of table
+		while (getline(calibrationFile, line))
+		{
+			if (line.empty())
+			{
+				break;
+			}
+			CalibrationPoint point{};
+			if (sscanf_s(line.c_str(), "%f,%f", &point.marker, &point.positionZ) != 2)
+			{
+				throw std::exception(("Wrong calibration table: " + calibrationFilename).c_str());
+			}
+			calibrationTable.push_back(point);
+		}
+
+		// Table is searched by marker
+		std::sort(calibrationTable.begin(), calibrationTable.end(),
+			[](const CalibrationPoint& a, const CalibrationPoint& b) { return a.marker < b.marker; });
+
+		m_regression = regression;
+		m_calibrationTable = calibrationTable;
+		if ((m_calibrationType == CalibrationType::CALIBRATION_TABLE) && (m_calibrationTable.size() < 2))
+		{
+			throw std::exception(("Not enough points in calibration table: " + calibrationFilename).c_str());
+		}
+	}
+
+	// 8-bit frame in memory, rows are stride bytes apart
+	float processFrame(const byte* pixels, size_t rows, size_t cols, size_t stride)
+	{
+		Timer timer;
+		timer.start();
+
+		cv::Mat frame((int)rows, (int)cols, CV_8UC1, (void*)pixels, stride);
+		float marker = calculateMarker(frame);
+		float positionZ = getPositionZ(marker);
+
+		timer.end();
+		if (m_latencyWindow > 0)
+		{
+			m_latencies[m_latencyIndex] = 1000.0 * timer.getDuration();
+			m_latencyIndex = (m_latencyIndex + 1) % m_latencyWindow;
+		}
+		m_framesNum++;
+
+		return positionZ;
+	}
+
+	// Percentiles over the last frames of the latency window
+	LatencyPercentiles getLatencyPercentiles()
+	{
+		LatencyPercentiles percentiles{};
+		percentiles.framesNum = m_framesNum;
+		size_t latenciesNum = std::min(m_framesNum, m_latencyWindow);
+		if (latenciesNum == 0)
+		{
+			return percentiles;
+		}
+
+		std::copy(m_latencies.begin(), m_latencies.begin() + latenciesNum, m_latenciesSorted.begin());
+		auto first = m_latenciesSorted.begin();
+		auto last = m_latenciesSorted.begin() + latenciesNum;
+		auto percentile = [&](size_t percent)
+		{
+			auto nth = first + (latenciesNum - 1) * percent / 100;
+			std::nth_element(first, nth, last);
+			return *nth;
+		};
+		percentiles.p50 = percentile(50);
+		percentiles.p90 = percentile(90);
+		percentiles.p99 = percentile(99);
+		percentiles.max = *std::max_element(first, last);
+		return percentiles;
+	}
+
+	void resetLatencies()
+	{
+		std::fill(m_latencies.begin(), m_latencies.end(), 0.0);
+		m_latencyIndex = 0;
+		m_framesNum = 0;
+	}
+
+private:
+	FocusMetricType m_metricType;
+	SpectrumAnalyzer m_spectrumAnalyzer;
+	cv::Mat m_spectrum;
+	RegressionResult m_regression;
+	std::vector<CalibrationPoint> m_calibrationTable;
+
+	// Ring of last latencies and its copy for percentiles
+	std::vector<double> m_latencies;
+	std::vector<double> m_latenciesSorted;
+	size_t m_latencyIndex;
+	size_t m_framesNum;
+
+	// Parameters from configuration
+	CalibrationType m_calibrationType;
+	size_t m_imagePartCenter;
+	size_t m_latencyWindow;
+
+private:
+	void initConfig(const ConfigSnapshot& config)
+	{
+		// Get parameters from configuration
+		if (config.focusing.isCompareMethod)
+		{
+			throw std::exception("Focus lock does not support method: Compare");
+		}
+		m_metricType = config.focusing.metricType;
+		m_imagePartCenter =
+			(m_metricType == FocusMetricType::METRIC_MODE) ? config.focusing.modeImagePartCenter :
+			(m_metricType == FocusMetricType::METRIC_VARIANCE) ? config.focusing.varianceImagePartCenter :
+			config.focusing.gradientImagePartCenter;
+		m_calibrationType = config.focusing.lockCalibrationType;
+		m_latencyWindow = config.focusing.lockLatencyWindow;
+	}
+
+	float calculateMarker(cv::Mat& frame)
+	{
+		if (m_metricType == FocusMetricType::METRIC_SPECTRUM)
+		{
+			// Spectrum image is used only if spectrum bitmaps are configured
+			if ((m_spectrum.rows != frame.rows) || (m_spectrum.cols != frame.cols))
+			{
+				m_spectrum = cv::Mat(frame.rows, frame.cols, CV_8U);
+			}
+			return m_spectrumAnalyzer.calculateEnergyDiff(frame, m_spectrum);
+		}
+
+		if ((m_metricType == FocusMetricType::METRIC_MODE) || (m_metricType == FocusMetricType::METRIC_VARIANCE))
+		{
+			ImageStatistics statistics = HistogramEngine::calculateStatistics(frame, m_imagePartCenter);
+			return (m_metricType == FocusMetricType::METRIC_MODE) ?
+				(float)statistics.modeGrayLevelIndex : statistics.variance;
+		}
+
+		GradientMetrics metrics = FocusMetrics::calculateGradientMetrics(frame, m_imagePartCenter);
+		return
+			(m_metricType == FocusMetricType::METRIC_TENENGRAD) ? metrics.tenengrad :
+			(m_metricType == FocusMetricType::METRIC_LAPLACIAN) ? metrics.laplacian :
+			metrics.brenner;
+	}
+
+	float getPositionZ(float marker)
+	{
+		if ((m_calibrationType == CalibrationType::CALIBRATION_REGRESSION) || (m_calibrationTable.size() < 2))
+		{
+			return m_regression.slope * marker + m_regression.offset;
+		}
+
+		// Linear interpolation between neighbor points of the table, clamped at its ends
+		if (marker <= m_calibrationTable.front().marker)
+		{
+			return m_calibrationTable.front().positionZ;
+		}
+		if (marker >= m_calibrationTable.back().marker)
+		{
+			return m_calibrationTable.back().positionZ;
+		}
+		auto upper = std::upper_bound(m_calibrationTable.begin(), m_calibrationTable.end(), marker,
+			[](float val, const CalibrationPoint& point) { return val < point.marker; });
+		auto lower = upper - 1;
+		float markerRange = upper->marker - lower->marker;
+		if (markerRange <= 0.0F)
+		{
+			return lower->positionZ;
+		}
+		float ratio = (marker - lower->marker) / markerRange;
+		return lower->positionZ + ratio * (upper->positionZ - lower->positionZ);
+	}
+};
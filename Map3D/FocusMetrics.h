@@ -0,0 +1,260 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <fstream>
+
+#include "HistogramEngine.h"
+#include "SpectrumAnalyzer.h"
+
+#pragma warning(disable: 26812)
+
+// Sharpness of the image calculated from its gradients
+struct GradientMetrics
+{
+	float tenengrad;	// mean squared Sobel gradient magnitude
+	float laplacian;	// variance of Laplacian
+	float brenner;		// mean squared difference of pixels two columns apart
+};
+
+class FocusMetrics
+{
+public:
+	// All gradient metrics of central part of the image are calculated in one pass over its rows
+	static GradientMetrics calculateGradientMetrics(const cv::Mat& image, size_t imagePartCenter)
+	{
+		GradientMetrics metrics{};
+		size_t rows = image.rows;
+		size_t cols = image.cols;
+		size_t imageMargin = imagePartCenter / 2;
+
+		// Sobel and Laplacian need neighbor rows and cols, Brenner needs col + 2
+		size_t rowBegin = std::max(imageMargin * rows / imagePartCenter, (size_t)1);
+		size_t rowEnd = std::min((imageMargin + 1) * rows / imagePartCenter, rows - 1);
+		size_t colBegin = std::max(imageMargin * cols / imagePartCenter, (size_t)1);
+		size_t colEnd = std::min((imageMargin + 1) * cols / imagePartCenter, cols - 2);
+		if ((rows < 3) || (cols < 4) || (rowBegin >= rowEnd) || (colBegin >= colEnd))
+		{
+			return metrics;
+		}
+
+		double sumTenengrad = 0.0;
+		double sumLaplacian1 = 0.0;
+		double sumLaplacian2 = 0.0;
+		double sumBrenner = 0.0;
+		for (size_t row = rowBegin; row < rowEnd; row++)
+		{
+			const byte* up = image.ptr<byte>((int)row - 1);
+			const byte* cur = image.ptr<byte>((int)row);
+			const byte* dn = image.ptr<byte>((int)row + 1);
+
+			// Sums of a row fit integers, so the inner loop has no floating point
+			int64_t rowTenengrad = 0;
+			int64_t rowLaplacian1 = 0;
+			int64_t rowLaplacian2 = 0;
+			int64_t rowBrenner = 0;
+			for (size_t col = colBegin; col < colEnd; col++)
+			{
+				int gx = (up[col + 1] + 2 * cur[col + 1] + dn[col + 1]) - (up[col - 1] + 2 * cur[col - 1] + dn[col - 1]);
+				int gy = (dn[col - 1] + 2 * dn[col] + dn[col + 1]) - (up[col - 1] + 2 * up[col] + up[col + 1]);
+				int laplacian = up[col] + dn[col] + cur[col - 1] + cur[col + 1] - 4 * cur[col];
+				int brenner = cur[col + 2] - cur[col];
+
+				rowTenengrad += gx * gx + gy * gy;
+				rowLaplacian1 += laplacian;
+				rowLaplacian2 += laplacian * laplacian;
+				rowBrenner += brenner * brenner;
+			}
+			sumTenengrad += (double)rowTenengrad;
+			sumLaplacian1 += (double)rowLaplacian1;
+			sumLaplacian2 += (double)rowLaplacian2;
+			sumBrenner += (double)rowBrenner;
+		}
+
+		double pixelsNum = (double)(rowEnd - rowBegin) * (colEnd - colBegin);
+		double expectationLaplacian = sumLaplacian1 / pixelsNum;
+		metrics.tenengrad = (float)(sumTenengrad / pixelsNum);
+		metrics.laplacian = (float)(sumLaplacian2 / pixelsNum - expectationLaplacian * expectationLaplacian);
+		metrics.brenner = (float)(sumBrenner / pixelsNum);
+		return metrics;
+	}
+};
+
+// Evaluates all selected focus metrics reading and decoding each image once
+class FocusEvaluator
+{
+public:
+	FocusEvaluator()
+	{
+		m_modeImagePartCenter = 0;
+		m_varianceImagePartCenter = 0;
+		m_gradientImagePartCenter = 0;
+	}
+
+	void init(const ConfigSnapshot& config)
+	{
+		initConfig(config);
+		m_spectrumAnalyzer.init(config);
+	}
+
+	// Metrics of all images are saved as table, a single metric is also saved as focusing result
+	std::vector<std::vector<float>> calculateMetrics(const std::string& imagesFolderName,
+		const std::string& outputFolderName, std::vector<float>& positionsZ, const std::vector<FocusMetricType>& metricTypes,
+		JobControl& control)
+	{
+		std::filesystem::path inputFolder = std::filesystem::absolute(std::filesystem::path(imagesFolderName));
+		std::string absFolderName = inputFolder.generic_string();
+		std::replace(absFolderName.begin(), absFolderName.end(), '/', '\\');
+		std::cout << "Input data folder:" << std::endl << absFolderName << std::endl << std::endl;
+
+		std::vector<std::vector<float>> metricValues = calculateMarkers(imagesFolderName, positionsZ.size(), metricTypes,
+			control);
+		saveMetrics(positionsZ, metricValues, metricTypes, outputFolderName);
+
+		// Single metric is saved as result of focusing method
+		if (metricTypes.size() == 1)
+		{
+			RegressionResult result = calculateRegression(metricValues[0], positionsZ);
+			saveResults(positionsZ, metricValues[0], result, outputFolderName);
+			saveCalibration(positionsZ, metricValues[0], result, outputFolderName);
+		}
+		return metricValues;
+	}
+
+	// Values of each metric for all images without any output
+	std::vector<std::vector<float>> calculateMarkers(const std::string& imagesFolderName, size_t imagesNum,
+		const std::vector<FocusMetricType>& metricTypes, JobControl& control)
+	{
+		const size_t filenameSize = 32;
+		char inputFilename[filenameSize];
+
+		std::vector<std::vector<float>> metricValues(metricTypes.size());
+		control.startStage("Processing of images", imagesNum);
+		for (size_t fileIndex = 0; fileIndex < imagesNum; fileIndex++)
+		{
+			control.checkCancelled();
+			sprintf_s(inputFilename, filenameSize, "Bright%4d.tif", (int)fileIndex);
+			cv::Mat wideImage = cv::imread(imagesFolderName + "/" + inputFilename, cv::IMREAD_GRAYSCALE);
+
+			float values[FocusMetricType::METRICS_NUM];
+			calculateImageMetrics(wideImage, metricTypes, values);
+			for (size_t metricIndex = 0; metricIndex < metricTypes.size(); metricIndex++)
+			{
+				metricValues[metricIndex].push_back(values[metricTypes[metricIndex]]);
+			}
+			control.advance();
+		}
+		return metricValues;
+	}
+
+	// Values are set only for the given metric types, indexed by type
+	void calculateImageMetrics(cv::Mat& image, const std::vector<FocusMetricType>& metricTypes, float* values)
+	{
+		bool isMode = contains(metricTypes, FocusMetricType::METRIC_MODE);
+		bool isVariance = contains(metricTypes, FocusMetricType::METRIC_VARIANCE);
+		bool isSpectrum = contains(metricTypes, FocusMetricType::METRIC_SPECTRUM);
+		bool isGradient =
+			contains(metricTypes, FocusMetricType::METRIC_TENENGRAD) ||
+			contains(metricTypes, FocusMetricType::METRIC_LAPLACIAN) ||
+			contains(metricTypes, FocusMetricType::METRIC_BRENNER);
+
+		if (isMode || isVariance)
+		{
+			ImageStatistics statistics = HistogramEngine::calculateStatistics(image,
+				isMode ? m_modeImagePartCenter : m_varianceImagePartCenter);
+			values[FocusMetricType::METRIC_MODE] = (float)statistics.modeGrayLevelIndex;
+			values[FocusMetricType::METRIC_VARIANCE] = statistics.variance;
+
+			// Histogram is calculated once if both metrics use the same central part
+			if (isMode && isVariance && (m_modeImagePartCenter != m_varianceImagePartCenter))
+			{
+				statistics = HistogramEngine::calculateStatistics(image, m_varianceImagePartCenter);
+				values[FocusMetricType::METRIC_VARIANCE] = statistics.variance;
+			}
+		}
+
+		if (isSpectrum)
+		{
+			cv::Mat spectrum(image.rows, image.cols, CV_8U);
+			values[FocusMetricType::METRIC_SPECTRUM] = m_spectrumAnalyzer.calculateEnergyDiff(image, spectrum);
+		}
+
+		if (isGradient)
+		{
+			GradientMetrics gradientMetrics = FocusMetrics::calculateGradientMetrics(image, m_gradientImagePartCenter);
+			values[FocusMetricType::METRIC_TENENGRAD] = gradientMetrics.tenengrad;
+			values[FocusMetricType::METRIC_LAPLACIAN] = gradientMetrics.laplacian;
+			values[FocusMetricType::METRIC_BRENNER] = gradientMetrics.brenner;
+		}
+	}
+
+private:
+	SpectrumAnalyzer m_spectrumAnalyzer;
+
+	// Parameters from configuration
+	size_t m_modeImagePartCenter;
+	size_t m_varianceImagePartCenter;
+	size_t m_gradientImagePartCenter;
+
+private:
+	void initConfig(const ConfigSnapshot& config)
+	{
+		// Get parameters from configuration
+		m_modeImagePartCenter		= config.focusing.modeImagePartCenter;
+		m_varianceImagePartCenter	= config.focusing.varianceImagePartCenter;
+		m_gradientImagePartCenter	= config.focusing.gradientImagePartCenter;
+	}
+
+	bool contains(const std::vector<FocusMetricType>& metricTypes, FocusMetricType metricType)
+	{
+		return std::find(metricTypes.begin(), metricTypes.end(), metricType) != metricTypes.end();
+	}
+
+	// Table of all metrics and regression of each metric with its error to compare the metrics
+	void saveMetrics(std::vector<float>& positionsZ, std::vector<std::vector<float>>& metricValues,
+		const std::vector<FocusMetricType>& metricTypes, const std::string& outputFolderName)
+	{
+		std::string metricsFilename = outputFolderName + "/FocusMetrics.csv";
+		std::ofstream metricsFile(metricsFilename);
+		metricsFile << "Index,Z given";
+		for (FocusMetricType metricType : metricTypes)
+		{
+			metricsFile << "," << focusMetricNames[metricType];
+		}
+		metricsFile << std::endl;
+
+		for (size_t posIndex = 0; posIndex < positionsZ.size(); posIndex++)
+		{
+			metricsFile << posIndex << "," << positionsZ[posIndex];
+			for (size_t metricIndex = 0; metricIndex < metricTypes.size(); metricIndex++)
+			{
+				metricsFile << "," << metricValues[metricIndex][posIndex];
+			}
+			metricsFile << std::endl;
+		}
+		metricsFile.close();
+
+		std::string regressionFilename = outputFolderName + "/FocusMetricsRegression.csv";
+		std::ofstream regressionFile(regressionFilename);
+		regressionFile << "Metric,Slope,Offset,RMS error of Z" << std::endl;
+		for (size_t metricIndex = 0; metricIndex < metricTypes.size(); metricIndex++)
+		{
+			RegressionResult result = calculateRegression(metricValues[metricIndex], positionsZ);
+			float sumError2 = 0.0F;
+			for (size_t posIndex = 0; posIndex < positionsZ.size(); posIndex++)
+			{
+				float positionCalc = result.slope * metricValues[metricIndex][posIndex] + result.offset;
+				float error = positionCalc - positionsZ[posIndex];
+				sumError2 += error * error;
+			}
+			float errorRMS = positionsZ.empty() ? 0.0F : std::sqrtf(sumError2 / positionsZ.size());
+
+			regressionFile <<
+				focusMetricNames[metricTypes[metricIndex]] << "," <<
+				result.slope << "," <<
+				result.offset << "," <<
+				errorRMS << std::endl;
+		}
+		regressionFile.close();
+	}
+};
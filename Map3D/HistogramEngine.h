@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#pragma warning(push)
+#pragma warning(disable: 5054)
+#include <opencv2/opencv.hpp>
+#pragma warning(pop)
+
+#include "Utils.h"
+
+const size_t GRAY_LEVELS = WHITE + 1;
+
+// Sub-histograms are updated by turns so that sequential equal pixels do not wait for each other's store
+const size_t SUB_HISTOGRAMS = 4;
+
+// Histogram of gray levels with its mode and variance
+class ImageStatistics
+{
+public:
+	size_t histogram[GRAY_LEVELS];
+	size_t modeGrayLevelIndex;
+	size_t modeGrayLevelValue;
+	float variance;
+	float standardDeviation;
+
+public:
+	ImageStatistics()
+	{
+		memset(histogram, 0, sizeof(histogram));
+		modeGrayLevelIndex = 0;
+		modeGrayLevelValue = 0;
+		variance = 0.0F;
+		standardDeviation = 0.0F;
+	}
+};
+
+class HistogramEngine
+{
+public:
+	// Histogram of 8-bit image within rows [rowBegin, rowEnd) and cols [colBegin, colEnd)
+	static void calculateHistogram(const cv::Mat& image, size_t rowBegin, size_t rowEnd,
+		size_t colBegin, size_t colEnd, size_t* histogram)
+	{
+		uint32_t subHistograms[SUB_HISTOGRAMS][GRAY_LEVELS];
+		memset(subHistograms, 0, sizeof(subHistograms));
+
+		const size_t pixelsInLoad = sizeof(uint64_t);
+		for (size_t row = rowBegin; row < rowEnd; row++)
+		{
+			// Each row is read contiguously by 8 pixels at once
+			const byte* pixels = image.ptr<byte>((int)row);
+			size_t col = colBegin;
+			for (; col + pixelsInLoad <= colEnd; col += pixelsInLoad)
+			{
+				uint64_t loaded;
+				memcpy(&loaded, pixels + col, pixelsInLoad);
+				subHistograms[0][(byte)(loaded)]++;
+				subHistograms[1][(byte)(loaded >> 8)]++;
+				subHistograms[2][(byte)(loaded >> 16)]++;
+				subHistograms[3][(byte)(loaded >> 24)]++;
+				subHistograms[0][(byte)(loaded >> 32)]++;
+				subHistograms[1][(byte)(loaded >> 40)]++;
+				subHistograms[2][(byte)(loaded >> 48)]++;
+				subHistograms[3][(byte)(loaded >> 56)]++;
+			}
+			for (; col < colEnd; col++)
+			{
+				subHistograms[0][pixels[col]]++;
+			}
+		}
+
+		// Merge sub-histograms
+		for (size_t grayLevel = 0; grayLevel < GRAY_LEVELS; grayLevel++)
+		{
+			histogram[grayLevel] =
+				(size_t)subHistograms[0][grayLevel] + subHistograms[1][grayLevel] +
+				subHistograms[2][grayLevel] + subHistograms[3][grayLevel];
+		}
+	}
+
+	// Statistics of central part of the image: the part is one of imagePartCenter x imagePartCenter parts
+	static ImageStatistics calculateStatistics(const cv::Mat& image, size_t imagePartCenter)
+	{
+		size_t rows = image.rows;
+		size_t cols = image.cols;
+		size_t imageMargin = imagePartCenter / 2;
+
+		size_t rowCenterL = imageMargin * rows / imagePartCenter;
+		size_t rowCenterR = (imageMargin + 1) * rows / imagePartCenter;
+		size_t colCenterL = imageMargin / imagePartCenter;
+		size_t colCenterR = (imageMargin + 1) * cols / imagePartCenter;
+
+		size_t pixelsNum = (rowCenterR - rowCenterL) * (colCenterR - colCenterL);
+
+		ImageStatistics statistics;
+		calculateHistogram(image, rowCenterL, rowCenterR, colCenterL, colCenterR, statistics.histogram);
+
+		size_t sum1GrayLevelValue = 0;
+		size_t sum2GrayLevelValue = 0;
+		for (size_t indexGrayLevel = BLACK; indexGrayLevel <= WHITE; indexGrayLevel++)
+		{
+			size_t valueGrayLevel = statistics.histogram[indexGrayLevel];
+			if (valueGrayLevel > statistics.modeGrayLevelValue)
+			{
+				statistics.modeGrayLevelIndex = indexGrayLevel;
+				statistics.modeGrayLevelValue = valueGrayLevel;
+			}
+			sum1GrayLevelValue += valueGrayLevel;
+			sum2GrayLevelValue += valueGrayLevel * valueGrayLevel;
+		}
+
+		float expectation1 = (float)sum1GrayLevelValue / pixelsNum; // equals 1 by definition
+		float expectation2 = (float)sum2GrayLevelValue / pixelsNum;
+		statistics.variance = expectation2 - expectation1 * expectation1;
+		statistics.standardDeviation = std::sqrtf(statistics.variance);
+		return statistics;
+	}
+};
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+
+// Progress of the running stage: completed items of all items and time elapsed since the stage started
+typedef void(__cdecl* ProgressCallback)(const char* stageName, int itemsDone, int itemsNum,
+	double elapsedMilliseconds, void* userData);
+
+enum JobStatus
+{
+	JOB_RUNNING,
+	JOB_COMPLETED,
+	JOB_CANCELLED,
+	JOB_FAILED
+};
+
+// Thrown by the stage when cancellation of the job is noticed
+class CancelledException : public std::exception
+{
+public:
+	const char* what() const noexcept override
+	{
+		return "Job is cancelled";
+	}
+};
+
+/*
+	Progress reporting and cooperative cancellation of stages.
+	Stages check cancellation between items - images, layers and capillaries, so the stage stops
+	within processing time of a single item. Items can be completed by parallel tasks.
+*/
+class JobControl
+{
+public:
+	JobControl()
+	{
+		m_callback = nullptr;
+		m_userData = nullptr;
+		m_isCancelled = false;
+		m_itemsDone = 0;
+		m_itemsNum = 0;
+	}
+
+	void setCallback(ProgressCallback callback, void* userData)
+	{
+		m_callback = callback;
+		m_userData = userData;
+	}
+
+	void startStage(const std::string& stageName, size_t itemsNum)
+	{
+		checkCancelled();
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stageName = stageName;
+		m_itemsDone = 0;
+		m_itemsNum = itemsNum;
+		m_stageStart = std::chrono::steady_clock::now();
+		report();
+	}
+
+	// Item is completed - does not throw, so it can be called also from parallel algorithms
+	void advance()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_itemsDone++;
+		report();
+	}
+
+	void cancel()
+	{
+		m_isCancelled = true;
+	}
+
+	// Checked instead of exception where it cannot be thrown, for example in parallel algorithms
+	bool isCancelled()
+	{
+		return m_isCancelled;
+	}
+
+	void checkCancelled()
+	{
+		if (m_isCancelled)
+		{
+			throw CancelledException();
+		}
+	}
+
+private:
+	ProgressCallback m_callback;
+	void* m_userData;
+	std::atomic<bool> m_isCancelled;
+
+	std::mutex m_mutex;
+	std::string m_stageName;
+	size_t m_itemsDone;
+	size_t m_itemsNum;
+	std::chrono::steady_clock::time_point m_stageStart;
+
+private:
+	void report()
+	{
+		if (m_callback == nullptr)
+		{
+			return;
+		}
+		double elapsedMilliseconds =
+			std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_stageStart).count();
+		m_callback(m_stageName.c_str(), (int)m_itemsDone, (int)m_itemsNum, elapsedMilliseconds, m_userData);
+	}
+};
+
+// Stage running on own thread - error message is valid when the job is finished
+class Job
+{
+public:
+	Job(ProgressCallback callback, void* userData)
+	{
+		m_control.setCallback(callback, userData);
+		m_status = JobStatus::JOB_RUNNING;
+	}
+
+	~Job()
+	{
+		wait();
+	}
+
+	// Callback is called when the job is finished with any status - after the status is set
+	void start(const std::function<void(JobControl&)>& stage, const std::function<void()>& onFinished)
+	{
+		m_future = std::async(std::launch::async, [this, stage, onFinished]()
+			{
+				JobStatus status = JobStatus::JOB_COMPLETED;
+				try
+				{
+					stage(m_control);
+				}
+				catch (const CancelledException&)
+				{
+					status = JobStatus::JOB_CANCELLED;
+				}
+				catch (const std::exception& exception)
+				{
+					m_error = exception.what();
+					status = JobStatus::JOB_FAILED;
+				}
+				m_status = status;
+				onFinished();
+			});
+	}
+
+	void cancel()
+	{
+		m_control.cancel();
+	}
+
+	JobStatus wait()
+	{
+		if (m_future.valid())
+		{
+			m_future.wait();
+		}
+		return m_status;
+	}
+
+	JobStatus getStatus()
+	{
+		return m_status;
+	}
+
+	const std::string& getError()
+	{
+		return m_error;
+	}
+
+private:
+	JobControl m_control;
+	std::future<void> m_future;
+	std::atomic<JobStatus> m_status;
+	std::string m_error;
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <future>
+#include <vector>
+
+#include "BoundedQueue.h"
+#include "Map.h"
+#include "LayerScanner.h"
+#include "CapillaryProcessor.h"
+
+// Completed layers waiting for the next stage - the previous stage waits when the queue is full
+const size_t LAYER_PIPELINE_QUEUE_SIZE = 2;
+
+/*
+	Stitching, detection and description of capillaries overlapped by layers.
+	Each stage runs on own thread and takes the layer as soon as the previous stage completes it:
+	the layer is detected when its last image is stitched and described when enough capillaries are found,
+	so total time approaches the time of the longest stage instead of the sum of all stages.
+*/
+class LayerPipeline
+{
+public:
+	// Returns described layers in the order of layers
+	std::vector<LayerInfo> processLayers(Map& map, LayerScanner& layerScanner, CapillaryProcessor& capillaryProcessor,
+		const ConfigSnapshot& config, JobControl& control)
+	{
+		std::cout << "Pipeline of layers started" << std::endl << std::endl;
+		m_timer.start();
+
+		const std::string& outputFolderName = config.folders.outputMap;
+		size_t layersNum = map.prepareLayers(config.folders.inputMap, config);
+		layerScanner.init(config);
+		capillaryProcessor.init(config);
+		std::string capillariesFolderName = layerScanner.createCapillariesFolder(outputFolderName);
+
+		// Item of the stage is the layer that is rejected by detection or described
+		control.startStage("Pipeline of layers", layersNum);
+
+		BoundedQueue<size_t> stitchedLayers(LAYER_PIPELINE_QUEUE_SIZE);
+		BoundedQueue<LayerInfo> detectedLayers(LAYER_PIPELINE_QUEUE_SIZE);
+		std::vector<LayerInfo> describedLayers;
+
+		// Failed or cancelled stage stops all other stages
+		auto abortStages = [&]()
+			{
+				stitchedLayers.abort();
+				detectedLayers.abort();
+			};
+
+		std::future<void> detection = std::async(std::launch::async, [&]()
+			{
+				try
+				{
+					size_t layerIndex = 0;
+					while (stitchedLayers.pop(layerIndex))
+					{
+						control.checkCancelled();
+						LayerInfo layerInfo = layerScanner.detectLayer(map, layerIndex, capillariesFolderName);
+						if (layerScanner.hasEnoughCapillaries(layerInfo))
+						{
+							detectedLayers.push(layerInfo);
+						}
+						else
+						{
+							std::cout << "Not enough capillaries found in layer " << layerIndex + 1 <<
+								std::endl << std::endl;
+							control.advance();
+						}
+					}
+					detectedLayers.close();
+				}
+				catch (...)
+				{
+					abortStages();
+					throw;
+				}
+			});
+
+		std::future<void> description = std::async(std::launch::async, [&]()
+			{
+				try
+				{
+					LayerInfo layerInfo;
+					while (detectedLayers.pop(layerInfo))
+					{
+						capillaryProcessor.describeCapillaries(map, layerInfo, outputFolderName, control);
+						describedLayers.push_back(layerInfo);
+						control.advance();
+					}
+				}
+				catch (...)
+				{
+					abortStages();
+					throw;
+				}
+			});
+
+		// Stitching runs on the calling thread - futures wait for other stages when leaving the scope
+		try
+		{
+			map.stitchLayers(config.folders.inputMap, control,
+				[&](size_t layerIndex) { return stitchedLayers.push(layerIndex); });
+			stitchedLayers.close();
+		}
+		catch (...)
+		{
+			abortStages();
+			throw;
+		}
+
+		// Error of the failed stage is thrown here
+		detection.get();
+		description.get();
+
+		// Layers are described in the order of completion of their stitching
+		std::sort(describedLayers.begin(), describedLayers.end(), [](const LayerInfo& layerL, const LayerInfo& layerR) {
+			return layerL.layerIndex < layerR.layerIndex;
+		});
+
+		m_timer.end();
+		std::cout << "Pipeline of layers completed in " <<
+			m_timer.getDurationMilliseconds() << " ms" << std::endl << std::endl;
+
+		return describedLayers;
+	}
+
+private:
+	Timer m_timer;
+};
@@ -9,25 +9,15 @@
 class LayerScanner
 {
 public:
-	std::vector<LayerInfo> detectCapillaries(Map& map, const std::string& outputFolderName, Config& config)
+	std::vector<LayerInfo> detectCapillaries(Map& map, const std::string& outputFolderName,
+		const ConfigSnapshot& config, JobControl& control)
 	{
 		std::cout << "Detection of capillaries started" << std::endl << std::endl;
 		m_timer.start();
 
-		m_cornerDetector.init(config);
-
-		// Create folder for capillaries data
-		std::string capillariesFolderName = outputFolderName + "/Capillaries";
+		init(config);
+		std::string capillariesFolderName = createCapillariesFolder(outputFolderName);
 #ifdef _DEBUG
-		if (!std::filesystem::exists(std::filesystem::path(capillariesFolderName)))
-		{
-			bool result = std::filesystem::create_directory(std::filesystem::path(capillariesFolderName));
-			if (!result)
-			{
-				throw std::exception(("Cannot create folder: " + capillariesFolderName).c_str());
-			}
-		}
-
 		// Create and init file containing data of all layers
 		std::string filenameAllLayers = capillariesFolderName + "/AllLayersDetection.csv";
 		std::ofstream fileAllLayers(filenameAllLayers);
@@ -36,39 +26,30 @@ public:
 		std::vector<LayerInfo> layersWithCapillaries;
 
 		// For each layer
-		std::vector<Layer> layers = map.getLayers();
-		for (size_t layerIndex = 0; layerIndex < layers.size(); layerIndex++)
+		size_t layersNum = map.getLayers().size();
+		control.startStage("Detection of capillaries", layersNum);
+		for (size_t layerIndex = 0; layerIndex < layersNum; layerIndex++)
 		{
+			control.checkCancelled();
+
 			// Find corners in the layer and score them depending on stand out from the background
-			Layer layer = layers[layerIndex];
-			m_cornerDetector.setLayerPosition(layer.z);
-			std::vector<ScoredCorner> scoredCorners = m_cornerDetector.getCornersSobel(map, layer.matrix,
-				capillariesFolderName, layerIndex);
-
-			// Update layer info by detected corners of capillaries
-			LayerInfo layerInfo;
-			layerInfo.layerIndex = layerIndex;
-			layerInfo.z = layer.z;
-			layerInfo.capillaryApexes = scoredCorners;
-			layerInfo.maxScore = scoredCorners.size() > 0 ? scoredCorners.begin()->score : 0;
-			layerInfo.sumScore = std::accumulate(scoredCorners.begin(), scoredCorners.end(), 0.0F,
-				[](float sum, const ScoredCorner& corner) { return sum + corner.score; });
+			LayerInfo layerInfo = detectLayer(map, layerIndex, capillariesFolderName);
 
 #ifdef _DEBUG
 			std::cout <<
 				"Layer:     " << layerIndex + 1 << std::endl <<
-				"Corners:   " << scoredCorners.size() << std::endl <<
+				"Corners:   " << layerInfo.capillaryApexes.size() << std::endl <<
 				"Max score: " << std::setprecision(6) << layerInfo.maxScore << std::endl <<
 				"Sum score: " << std::setprecision(6) << layerInfo.sumScore << std::endl << std::endl;
 
 			std::string printedLine =
 				std::to_string(layerIndex + 1) + "," +
-				std::to_string(scoredCorners.size()) + "," +
+				std::to_string(layerInfo.capillaryApexes.size()) + "," +
 				toString(layerInfo.maxScore, 1) + "," +
 				toString(layerInfo.sumScore, 1);
 			fileAllLayers << printedLine << std::endl;
 #endif
-			if ((scoredCorners.size() >= m_cornerDetector.getMinFoundCapillaries()) && (layerInfo.sumScore > 0.0F))
+			if (hasEnoughCapillaries(layerInfo))
 			{
 				layersWithCapillaries.push_back(layerInfo);
 			}
@@ -76,6 +57,7 @@ public:
 			{
 				std::cout << "Not enough capillaries found in layer " << layerIndex + 1 << std::endl << std::endl;
 			}
+			control.advance();
 		}
 
 #ifdef _DEBUG
@@ -88,6 +70,62 @@ public:
 		return layersWithCapillaries;
 	}
 
+	void init(const ConfigSnapshot& config)
+	{
+		m_cornerDetector.init(config);
+	}
+
+	// Folder for capillaries data is used only in debug configuration
+	std::string createCapillariesFolder(const std::string& outputFolderName)
+	{
+		std::string capillariesFolderName = outputFolderName + "/Capillaries";
+#ifdef _DEBUG
+		if (!std::filesystem::exists(std::filesystem::path(capillariesFolderName)))
+		{
+			bool result = std::filesystem::create_directory(std::filesystem::path(capillariesFolderName));
+			if (!result)
+			{
+				throw std::exception(("Cannot create folder: " + capillariesFolderName).c_str());
+			}
+		}
+#endif
+		return capillariesFolderName;
+	}
+
+	// Detection of single layer reads only this layer and seams of the map
+	LayerInfo detectLayer(Map& map, size_t layerIndex, const std::string& capillariesFolderName)
+	{
+		TRACE_SCOPE("Detect layer");
+		Layer layer = map.getLayers()[layerIndex];
+		ByteMatrix gradient = m_cornerDetector.calculateGradient(layer.matrix);
+		return detectLayer(map, layer, layerIndex, gradient, capillariesFolderName);
+	}
+
+	// Detection of the layer on its already calculated gradient
+	LayerInfo detectLayer(Map& map, Layer& layer, size_t layerIndex, ByteMatrix& gradient,
+		const std::string& capillariesFolderName)
+	{
+		m_cornerDetector.setLayerPosition(layer.z);
+		std::vector<ScoredCorner> scoredCorners = m_cornerDetector.findCorners(map, layer.matrix, gradient,
+			capillariesFolderName, layerIndex);
+
+		// Update layer info by detected corners of capillaries
+		LayerInfo layerInfo;
+		layerInfo.layerIndex = layerIndex;
+		layerInfo.z = layer.z;
+		layerInfo.capillaryApexes = scoredCorners;
+		layerInfo.maxScore = scoredCorners.size() > 0 ? scoredCorners.begin()->score : 0;
+		layerInfo.sumScore = std::accumulate(scoredCorners.begin(), scoredCorners.end(), 0.0F,
+			[](float sum, const ScoredCorner& corner) { return sum + corner.score; });
+		return layerInfo;
+	}
+
+	bool hasEnoughCapillaries(const LayerInfo& layerInfo)
+	{
+		return (layerInfo.capillaryApexes.size() >= m_cornerDetector.getMinFoundCapillaries()) &&
+			(layerInfo.sumScore > 0.0F);
+	}
+
 private:
 	CornerDetector m_cornerDetector;
 	Timer m_timer;
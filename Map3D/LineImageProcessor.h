@@ -8,18 +8,18 @@
 class LineImageProcessor
 {
 public:
-	void calculateGradient(std::vector<Projection>& projections, const std::string& outputFolderName)
+	void calculateGradient(Sequence& projections, const std::string& outputFolderName)
 	{
 #ifdef _DEBUG
 		createFoldersIfNeed(outputFolderName, "Gradients");
 		size_t fileIndex = 0;
 		for (Projection projection : projections)
 		{
-			ByteMatrix gradMatrix(projection.lineMatrix.rows(), projection.lineMatrix.cols());
-			calculateGradientY(projection.lineMatrix, gradMatrix);
+			BitMatrix gradMatrix(projection.lineMatrix.rows(), projection.lineMatrix.cols());
+			projection.lineMatrix.gradientY(gradMatrix);
 			std::string gradFilename = outputFolderName + "/Gradients/LineGrad" +
 				std::to_string(fileIndex++) + ".bmp";
-			bool result = cv::imwrite(gradFilename, gradMatrix.asCvMatU8());
+			bool result = cv::imwrite(gradFilename, gradMatrix.asByteMatrix(WHITE, BLACK).asCvMatU8());
 			if (!result)
 			{
 				throw std::exception(("Cannot write file: " + gradFilename).c_str());
@@ -28,7 +28,7 @@ public:
 #endif
 	}
 
-	void calculateStatistics(std::vector<Projection>& projections, const std::string& outputFolderName)
+	void calculateStatistics(Sequence& projections, const std::string& outputFolderName)
 	{
 		createFoldersIfNeed(outputFolderName, "Statistics");
 		size_t fileIndex = 0;
@@ -43,68 +43,46 @@ public:
 	}
 
 private:
-	void calculateGradientY(ByteMatrix& lineMatrix, ByteMatrix& gradMatrix)
+	void countWhitePixels(BitMatrix& matrix, std::ofstream& whiteInColsFile)
 	{
-		size_t rows = lineMatrix.rows();
-		size_t cols = lineMatrix.cols();
+		std::vector<size_t> whitePixels = matrix.countInCols();
 
-		for (size_t row = 0; row < rows; row++)
+		std::vector<float> smoothed = smoothExponential(whitePixels);
+		for (size_t col = 0; col < whitePixels.size(); col++)
 		{
-			for (size_t col = 0; col < cols; col++)
-			{
-				if ((row == 0) || (row == rows - 1))
-				{
-					gradMatrix.set(row, col, 0);
-					continue;
-				}
-				byte valPrevRow = lineMatrix.get(row - 1, col);
-				byte valNextRow = lineMatrix.get(row + 1, col);
-				byte valGradRow = valPrevRow == valNextRow ? BLACK : WHITE;
-				gradMatrix.set(row, col, valGradRow);
-			}
+			whiteInColsFile << col << "," << whitePixels[col] << "," << smoothed[col] << std::endl;
 		}
 	}
 
-	void countWhitePixels(ByteMatrix& matrix, std::ofstream& whiteInColsFile)
+	// Weighted sum of the last order + 1 values with weights depth, depth^2, ... is updated recursively:
+	// S[col] = depth * (x[col] + S[col - 1]) - depth^(order + 2) * x[col - order - 1]
+	std::vector<float> smoothExponential(const std::vector<size_t>& values)
 	{
-		size_t rows = matrix.rows();
-		size_t cols = matrix.cols();
-
-		std::vector<size_t> whitePixels;
-		for (size_t col = 0; col < cols; col++)
-		{
-			size_t sumInCol = 0;
-			for (size_t row = 0; row < rows; row++)
-			{
-				sumInCol += matrix.get(row, col);
-			}
-			whitePixels.push_back(sumInCol / WHITE);
-		}
-
 		const size_t smoothingOrder = 100;
-		const float smoothingDepth = 0.99F;
-		float weight = 1.0F;
-		std::vector<float> weights;
-		float sumWeights = 0.0F;
+		const double smoothingDepth = 0.99;
+		double weight = 1.0;
+		double sumWeights = 0.0;
 		for (size_t i = 0; i <= smoothingOrder; i++)
 		{
 			weight *= smoothingDepth;
-			weights.push_back(weight);
 			sumWeights += weight;
 		}
+		double weightDropped = weight * smoothingDepth;
 
-		for (size_t col = 0; col < cols; col++)
+		std::vector<float> smoothed(values.size(), 0.0F);
+		double weightedSum = 0.0;
+		for (size_t col = 0; col < values.size(); col++)
 		{
-			float smothed = 0.0F;
+			weightedSum = smoothingDepth * (values[col] + weightedSum);
+			if (col > smoothingOrder)
+			{
+				weightedSum -= weightDropped * values[col - smoothingOrder - 1];
+			}
 			if (col >= smoothingOrder)
 			{
-				for (size_t i = 0; i <= smoothingOrder; i++)
-				{
-					smothed += weights[i] * whitePixels[col - i];
-				}
-				smothed /= sumWeights;
+				smoothed[col] = (float)(weightedSum / sumWeights);
 			}
-			whiteInColsFile << col << "," << whitePixels[col] << "," << smothed << std::endl;
 		}
+		return smoothed;
 	}
 };
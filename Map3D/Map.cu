@@ -17,6 +17,7 @@
 
 Map::Map()
 {
+	m_pixelsInMm = 0;
 	m_scanPosFilename.clear();
 	m_markerCornerSize = 0;
 	m_imageBiasPixelsX = 0;
@@ -25,6 +26,8 @@ Map::Map()
 	m_imageMarginRelativeY = 0.0F;
 	m_imageFrameRelativeW = 0.0F;
 	m_imageFrameRelativeH = 0.0F;
+	m_toleranceZmm = 0.0F;
+	m_deepSmoothingKernelSize = 0;
 
 	m_startXmm = 0.0F;
 	m_startYmm = 0.0F;
@@ -32,10 +35,16 @@ Map::Map()
 	m_stepYmm = 0.0F;
 	m_rows = 0;
 	m_cols = 0;
+
+	m_tileRows = 0;
+	m_tileCols = 0;
+	m_tilesNum = 0;
+	m_isTileScanOpen = false;
 }
 
-void Map::buildMap(const std::string& folderName, Config& config)
+void Map::buildMap(const std::string& folderName, const ConfigSnapshot& config, JobControl& control)
 {
+	TRACE_SCOPE("Build map");
 #ifdef _DEBUG
 	std::string buildConfig = "DEBUG";
 #else
@@ -47,6 +56,7 @@ void Map::buildMap(const std::string& folderName, Config& config)
 
 	// Get parameters from configuration
 	initConfig(config);
+	clearLayers();
 
 	// Vector of X-Y-Z coordinates
 	std::vector<std::vector<std::string>> scanPositions = readScanPositions(folderName);
@@ -54,7 +64,7 @@ void Map::buildMap(const std::string& folderName, Config& config)
 	// Images in the order of above scan positions
 	std::cout << "Start loading of " << scanPositions[0].size() << " images" << std::endl;
 	m_timer.start();
-	std::vector<cv::Mat> images = readImages(folderName);
+	std::vector<cv::Mat> images = readImages(folderName, control);
 	m_timer.end();
 	std::cout << "Images are loaded in " <<
 		m_timer.getDurationMilliseconds() << " ms" << std::endl << std::endl;
@@ -65,13 +75,225 @@ void Map::buildMap(const std::string& folderName, Config& config)
 	// Build stitched images on each layer
 	std::cout << "Start stitching of " << scanPositions[0].size() << " images" << std::endl;
 	m_timer.start();
-	size_t deepSmoothingKernelSize = (size_t)config.getIntValue(keyDeepSmoothingKernelSize);
-	stitchImages(scanPositions, images, deepSmoothingKernelSize);
+	stitchImages(scanPositions, images, control);
 	m_timer.end();
 	std::cout << "Images are stitched in " <<
 		m_timer.getDurationMilliseconds() << " ms" << std::endl << std::endl;
 }
 
+/*
+	Allocate layers of the map before stitching by layers, so completed layers can be processed
+	while other layers are stitched. Returns number of layers.
+*/
+size_t Map::prepareLayers(const std::string& folderName, const ConfigSnapshot& config)
+{
+	TRACE_SCOPE("Prepare layers");
+	// Get parameters from configuration
+	initConfig(config);
+	clearLayers();
+
+	// Size of all images is the same as of the first one
+	m_scanPositions = readScanPositions(folderName);
+	cv::Mat firstImage = readImage(folderName, 0);
+	initLayers(firstImage);
+
+	// Seams are stored in advance, so stitching does not change them while completed layers are processed
+	for (size_t indexX = 0; indexX < m_indexedPositionsX.size(); indexX++)
+	{
+		for (size_t indexY = 0; indexY < m_indexedPositionsY.size(); indexY++)
+		{
+			addSeams(indexX, indexY);
+		}
+	}
+
+	// Store start position with initial margins for further calculation of capillaries positions
+	m_startXmm = (float)atof(m_scanPositions[0][0].c_str()) +
+		pixels2mm((size_t)(m_imageMarginRelativeX * firstImage.cols), m_pixelsInMm);
+	m_startYmm = (float)atof(m_scanPositions[1][0].c_str()) +
+		pixels2mm((size_t)(m_imageMarginRelativeY * firstImage.rows), m_pixelsInMm);
+
+	return m_layers.size();
+}
+
+/*
+	Load and stitch images one by one and report each layer when its last image is stitched.
+	Stitching stops when the callback returns false.
+*/
+void Map::stitchLayers(const std::string& folderName, JobControl& control,
+	const std::function<bool(size_t layerIndex)>& onLayerStitched)
+{
+	TRACE_SCOPE("Stitch layers");
+	// Positions by coordinates
+	const std::vector<std::string>& positionsX = m_scanPositions[0];
+	const std::vector<std::string>& positionsY = m_scanPositions[1];
+	const std::vector<std::string>& positionsZ = m_scanPositions[2];
+
+	// Number of images left to stitch in each layer
+	std::vector<size_t> imagesLeft(m_layers.size(), 0);
+	for (const std::string& positionZ : positionsZ)
+	{
+		imagesLeft[m_indexedPositionsZ[(float)atof(positionZ.c_str())]]++;
+	}
+
+	for (size_t imageIndex = 0; imageIndex < positionsZ.size(); imageIndex++)
+	{
+		control.checkCancelled();
+		cv::Mat image = readImage(folderName, imageIndex);
+
+		// Position of iterated source image
+		float x = (float)atof(positionsX[imageIndex].c_str());
+		float y = (float)atof(positionsY[imageIndex].c_str());
+		float z = (float)atof(positionsZ[imageIndex].c_str());
+
+		// Index is in flipped direction by X and in the same direction by Y
+		size_t indexX = m_indexedPositionsX.size() - 1 - m_indexedPositionsX[x];
+		size_t indexY = m_indexedPositionsY[y];
+
+		size_t layerIndex = m_indexedPositionsZ[z];
+		stitchTile(m_layers[layerIndex].matrix, image, indexX, indexY);
+
+		imagesLeft[layerIndex]--;
+		if ((imagesLeft[layerIndex] == 0) && !onLayerStitched(layerIndex))
+		{
+			return;
+		}
+	}
+}
+
+void Map::beginTileScan(const ConfigSnapshot& config, float startX, float startY, float stepX, float stepY,
+	size_t countX, size_t countY, size_t tileRows, size_t tileCols)
+{
+	if ((stepX <= 0.0F) || (stepY <= 0.0F))
+	{
+		throw std::exception("Steps of the scan grid must be positive");
+	}
+	if ((countX == 0) || (countY == 0) || (tileRows == 0) || (tileCols == 0))
+	{
+		throw std::exception("Scan grid and tiles must not be empty");
+	}
+
+	// Get parameters from configuration
+	initConfig(config);
+
+	// Grid is known in advance, layers are added by Z positions of arriving tiles
+	clearLayers();
+	m_indexedPositionsX.clear();
+	m_indexedPositionsY.clear();
+	m_indexedPositionsZ.clear();
+	for (size_t index = 0; index < countX; index++)
+	{
+		m_indexedPositionsX[startX + stepX * index] = index;
+	}
+	for (size_t index = 0; index < countY; index++)
+	{
+		m_indexedPositionsY[startY + stepY * index] = index;
+	}
+	m_stepXmm = stepX;
+	m_stepYmm = stepY;
+	m_tileRows = tileRows;
+	m_tileCols = tileCols;
+	initLayerSize(tileRows, tileCols);
+
+	// Store start position with initial margins for further calculation of capillaries positions
+	m_startXmm = startX + pixels2mm((size_t)(m_imageMarginRelativeX * tileCols), m_pixelsInMm);
+	m_startYmm = startY + pixels2mm((size_t)(m_imageMarginRelativeY * tileRows), m_pixelsInMm);
+
+	m_isTileScanOpen = true;
+}
+
+/*
+	Stitch single tile of the running scan directly from the buffer of the camera.
+	The buffer is not retained, so it can be reused by the caller when the function returns.
+*/
+void Map::addTile(const byte* pixels, size_t rows, size_t cols, size_t stride, float x, float y, float z)
+{
+	TRACE_SCOPE("Add tile");
+	if (!m_isTileScanOpen)
+	{
+		throw std::exception("Tile scan is not started");
+	}
+	if ((pixels == nullptr) || (rows != m_tileRows) || (cols != m_tileCols) || (stride < cols))
+	{
+		throw std::exception("Tile does not match the started scan");
+	}
+
+	// Snap stage position to the scan grid
+	float gridX = std::roundf((x - m_indexedPositionsX.begin()->first) / m_stepXmm);
+	float gridY = std::roundf((y - m_indexedPositionsY.begin()->first) / m_stepYmm);
+	if ((gridX < 0.0F) || (gridX >= (float)m_indexedPositionsX.size()) ||
+		(gridY < 0.0F) || (gridY >= (float)m_indexedPositionsY.size()))
+	{
+		throw std::exception("Tile position is out of the scan grid");
+	}
+
+	// Index is in flipped direction by X and in the same direction by Y
+	size_t indexX = m_indexedPositionsX.size() - 1 - (size_t)gridX;
+	size_t indexY = (size_t)gridY;
+
+	// Z read back from the stage jitters: the tile belongs to the nearest layer within the tolerance
+	size_t layerIndex = m_layers.size();
+	float minDistanceZ = m_toleranceZmm;
+	for (size_t index = 0; index < m_layers.size(); index++)
+	{
+		float distanceZ = std::fabs(m_layers[index].z - z);
+		if (distanceZ <= minDistanceZ)
+		{
+			layerIndex = index;
+			minDistanceZ = distanceZ;
+		}
+	}
+
+	// Add the layer on first tile of new z
+	if (layerIndex == m_layers.size())
+	{
+		m_layers.push_back(Layer(z, m_rows, m_cols));
+		m_stitchedTiles.push_back(std::vector<bool>(m_indexedPositionsX.size() * m_indexedPositionsY.size(), false));
+	}
+
+	// Wrap the buffer without copying
+	cv::Mat image((int)rows, (int)cols, CV_8UC1, (void*)pixels, stride);
+	stitchTile(m_layers[layerIndex].matrix, image, indexX, indexY);
+	m_stitchedTiles[layerIndex][(size_t)gridY * m_indexedPositionsX.size() + (size_t)gridX] = true;
+	m_tilesNum++;
+}
+
+/*
+	Lock the grid: layers are ordered by z as after building of the map from files.
+	The scan stays open if some layer is not complete, so missing tiles can be added.
+*/
+void Map::finalizeTileScan()
+{
+	TRACE_SCOPE("Finalize tile scan");
+	if (!m_isTileScanOpen)
+	{
+		throw std::exception("Tile scan is not started");
+	}
+	if (m_tilesNum == 0)
+	{
+		throw std::exception("No tiles are added to the scan");
+	}
+	for (size_t layerIndex = 0; layerIndex < m_layers.size(); layerIndex++)
+	{
+		const std::vector<bool>& stitchedTiles = m_stitchedTiles[layerIndex];
+		if (std::find(stitchedTiles.begin(), stitchedTiles.end(), false) != stitchedTiles.end())
+		{
+			throw std::exception(("Not all tiles are added to the layer at z = " +
+				std::to_string(m_layers[layerIndex].z)).c_str());
+		}
+	}
+
+	std::sort(m_layers.begin(), m_layers.end(), [](const Layer& layerL, const Layer& layerR) {
+		return layerL.z < layerR.z;
+	});
+	m_indexedPositionsZ.clear();
+	for (size_t layerIndex = 0; layerIndex < m_layers.size(); layerIndex++)
+	{
+		m_indexedPositionsZ[m_layers[layerIndex].z] = layerIndex;
+	}
+
+	m_isTileScanOpen = false;
+}
+
 void Map::printValueAtTruncatedPos(float x, float y, float z)
 {
 	std::cout << "Get value on some position truncated to scan grid" << std::endl;
@@ -130,6 +352,7 @@ void Map::printValueAtTruncatedPos(float x, float y, float z)
 
 void Map::saveStiched(std::vector<LayerInfo>& layersWithCapillaries, const std::string& outputFolderName)
 {
+	TRACE_SCOPE("Save stitched layers");
 	createFoldersIfNeed(outputFolderName, "Stitched");
 	size_t layersNum = m_layers.size();
 	std::cout << "Start saving of stitched images on " << layersNum << " layers" << std::endl;
@@ -199,21 +422,25 @@ float Map::getStartYmm()
 	==================================================================
 */
 
-void Map::initConfig(Config& config)
+void Map::initConfig(const ConfigSnapshot& config)
 {
 	// Get parameters from configuration
-	m_scanPosFilename		= config.getStringValue(keyScanPosFilename);
-	m_markerCornerSize		= (size_t)config.getIntValue(keyMarkerCornerSize);
-	m_imageBiasPixelsX		= (size_t)config.getIntValue(keyImageBiasPixelsX);
-	m_imageBiasPixelsY		= (size_t)config.getIntValue(keyImageBiasPixelsY);
-	m_imageMarginRelativeX	= config.getFloatValue(keyImageMarginRelX);
-	m_imageMarginRelativeY	= config.getFloatValue(keyImageMarginRelY);
-	m_imageFrameRelativeW	= config.getFloatValue(keyImageFrameRelW);
-	m_imageFrameRelativeH	= config.getFloatValue(keyImageFrameRelH);
+	m_pixelsInMm			= config.general.pixelsInMm;
+	m_scanPosFilename		= config.stitching.scanPosFilename;
+	m_markerCornerSize		= config.stitching.markerCornerSize;
+	m_imageBiasPixelsX		= config.stitching.imageBiasPixelsX;
+	m_imageBiasPixelsY		= config.stitching.imageBiasPixelsY;
+	m_imageMarginRelativeX	= config.stitching.imageMarginRelativeX;
+	m_imageMarginRelativeY	= config.stitching.imageMarginRelativeY;
+	m_imageFrameRelativeW	= config.stitching.imageFrameRelativeW;
+	m_imageFrameRelativeH	= config.stitching.imageFrameRelativeH;
+	m_toleranceZmm			= config.stitching.toleranceZ;
+	m_deepSmoothingKernelSize	= config.characterization.deepSmoothingKernelSize;
 }
 
 std::vector<std::vector<std::string>> Map::readScanPositions(const std::string& folderName)
 {
+	TRACE_SCOPE("Read scan positions");
 	// Open file with scan positions
 	std::string scanPosPathFilename = folderName + "/" + m_scanPosFilename;
 	std::ifstream scanPosFile(scanPosPathFilename);
@@ -291,35 +518,53 @@ std::map<float, size_t> Map::getUniqueIndexedPositions(const std::vector<std::st
 	return indexedPositions;
 }
 
-std::vector<cv::Mat> Map::readImages(const std::string& folderName)
+std::vector<cv::Mat> Map::readImages(const std::string& folderName, JobControl& control)
 {
+	TRACE_SCOPE("Read images");
 	size_t filesNum = getFilesNum(folderName);
+	control.startStage("Loading of images", filesNum);
 
-	const size_t filenameSize = 32;
-	char filename[filenameSize];
 	std::vector<cv::Mat> images;
 	for (size_t fileIndex = 0; fileIndex < filesNum; fileIndex++)
 	{
-		sprintf_s(filename, filenameSize, "Bright%4d.tif", (int)fileIndex);
-		std::string pathFilename = folderName + "/" + filename;
-		cv::Mat image = cv::imread(pathFilename, cv::IMREAD_GRAYSCALE);
+		control.checkCancelled();
+		cv::Mat image = readImage(folderName, fileIndex);
 
 		images.push_back(image);
 		if ((fileIndex > 0) && (fileIndex % 20 == 0))
 		{
 			std::cout << "Loaded " << std::setw(3) << fileIndex << " images" << std::endl;
 		}
+		control.advance();
 	}
 
 	return images;
 }
 
+cv::Mat Map::readImage(const std::string& folderName, size_t fileIndex)
+{
+	TRACE_SCOPE("Read image");
+	const size_t filenameSize = 32;
+	char filename[filenameSize];
+	sprintf_s(filename, filenameSize, "Bright%4d.tif", (int)fileIndex);
+	std::string pathFilename = folderName + "/" + filename;
+	return cv::imread(pathFilename, cv::IMREAD_GRAYSCALE);
+}
+
+// Map is built anew: layers of the previous map and the unfinished tile scan are dropped
+void Map::clearLayers()
+{
+	m_layers.clear();
+	m_seamRows.clear();
+	m_seamCols.clear();
+	m_tilesNum = 0;
+	m_isTileScanOpen = false;
+	m_stitchedTiles.clear();
+}
+
 void Map::initLayers(const cv::Mat& firstImage)
 {
-	m_cols = (size_t)((mm2pixels(m_stepXmm) + m_imageBiasPixelsX) * (m_indexedPositionsX.size() - 1) +
-		m_imageFrameRelativeW * firstImage.cols);
-	m_rows = (size_t)(mm2pixels(m_stepYmm) * (m_indexedPositionsY.size() - 1) +
-		m_imageFrameRelativeH * firstImage.rows - 2 * (m_indexedPositionsX.size() - 1) * m_imageBiasPixelsY);
+	initLayerSize((size_t)firstImage.rows, (size_t)firstImage.cols);
 	for (std::pair<float, size_t> indexedPositionZ : m_indexedPositionsZ)
 	{
 		float z = indexedPositionZ.first;
@@ -328,13 +573,18 @@ void Map::initLayers(const cv::Mat& firstImage)
 	}
 }
 
-void Map::stitchImages(const std::vector<std::vector<std::string>>& scanPositions,
-	const std::vector<cv::Mat>& images, size_t deepSmoothingKernelSize)
+void Map::initLayerSize(size_t imageRows, size_t imageCols)
 {
-	// Convert steps from mm to pixels and add preliminarly known biases if need
-	const size_t stepPixelsX = mm2pixels(m_stepXmm) + m_imageBiasPixelsX;
-	const size_t stepPixelsY = mm2pixels(m_stepYmm);
+	m_cols = (size_t)((mm2pixels(m_stepXmm, m_pixelsInMm) + m_imageBiasPixelsX) * (m_indexedPositionsX.size() - 1) +
+		m_imageFrameRelativeW * imageCols);
+	m_rows = (size_t)(mm2pixels(m_stepYmm, m_pixelsInMm) * (m_indexedPositionsY.size() - 1) +
+		m_imageFrameRelativeH * imageRows - 2 * (m_indexedPositionsX.size() - 1) * m_imageBiasPixelsY);
+}
 
+void Map::stitchImages(const std::vector<std::vector<std::string>>& scanPositions,
+	const std::vector<cv::Mat>& images, JobControl& control)
+{
+	TRACE_SCOPE("Stitch images");
 	// Positions by coordinates
 	const std::vector<std::string>& positionsX = scanPositions[0];
 	const std::vector<std::string>& positionsY = scanPositions[1];
@@ -342,13 +592,16 @@ void Map::stitchImages(const std::vector<std::vector<std::string>>& scanPosition
 
 	// Store start position with initial margins for further calculation of capillaries positions
 	m_startXmm = (float)atof(positionsX[0].c_str()) +
-		pixels2mm((size_t)(m_imageMarginRelativeX * images[0].cols));
+		pixels2mm((size_t)(m_imageMarginRelativeX * images[0].cols), m_pixelsInMm);
 	m_startYmm = (float)atof(positionsY[0].c_str()) +
-		pixels2mm((size_t)(m_imageMarginRelativeY * images[0].rows));
+		pixels2mm((size_t)(m_imageMarginRelativeY * images[0].rows), m_pixelsInMm);
 
 	// For all positions and corresponding images
+	control.startStage("Stitching of images", images.size());
 	for (size_t imageIndex = 0; imageIndex < images.size(); imageIndex++)
 	{
+		control.checkCancelled();
+
 		// Position of iterated source image
 		float x = (float)atof(positionsX[imageIndex].c_str());
 		float y = (float)atof(positionsY[imageIndex].c_str());
@@ -358,44 +611,63 @@ void Map::stitchImages(const std::vector<std::vector<std::string>>& scanPosition
 		size_t indexX = m_indexedPositionsX.size() - 1 - m_indexedPositionsX[x];
 		size_t indexY = m_indexedPositionsY[y];
 
-		// Calculate offsets in the desination image and store to skip unwanted corners on seams
-		size_t dstOffsetX = stepPixelsX * indexX;
-		size_t dstOffsetY = stepPixelsY * indexY + m_imageBiasPixelsY * indexX;
+		// Select destination layer according to z
+		size_t layerIndex = m_indexedPositionsZ[z];
+		stitchTile(m_layers[layerIndex].matrix, images[imageIndex], indexX, indexY);
+		control.advance();
+	}
+}
+
+void Map::stitchTile(ByteMatrix& dstMatrix, const cv::Mat& srcImage, size_t indexX, size_t indexY)
+{
+	TRACE_SCOPE("Stitch tile");
+	// Convert steps from mm to pixels and add preliminarly known biases if need
+	const size_t stepPixelsX = mm2pixels(m_stepXmm, m_pixelsInMm) + m_imageBiasPixelsX;
+	const size_t stepPixelsY = mm2pixels(m_stepYmm, m_pixelsInMm);
+
+	// Calculate offsets in the desination image and store to skip unwanted corners on seams
+	size_t dstOffsetX = stepPixelsX * indexX;
+	size_t dstOffsetY = stepPixelsY * indexY + m_imageBiasPixelsY * indexX;
+	addSeams(indexX, indexY);
+
+	// Frame width is non-onerlapped vertical area for all frames before last or whole last frame
+	size_t frameW = (indexX < m_indexedPositionsX.size() - 1) ?
+		stepPixelsX :
+		(size_t)(m_imageFrameRelativeW * srcImage.cols);
+
+	// Frame height is non-onerlapped horizontal area for all frames before last or whole last frame
+	size_t frameH = (indexY < m_indexedPositionsY.size() - 1) ?
+		stepPixelsY :
+		(size_t)(m_imageFrameRelativeH * srcImage.rows);
+
+	// Copy pixels from source to destination matrix
+	stitchSingleImage(dstMatrix, srcImage, dstOffsetX, dstOffsetY, frameW, frameH);
+}
+
+// Seams of the frame at given grid indices - the same for all layers
+void Map::addSeams(size_t indexX, size_t indexY)
+{
+	const size_t stepPixelsX = mm2pixels(m_stepXmm, m_pixelsInMm) + m_imageBiasPixelsX;
+	const size_t stepPixelsY = mm2pixels(m_stepYmm, m_pixelsInMm);
+	size_t dstOffsetX = stepPixelsX * indexX;
+	size_t dstOffsetY = stepPixelsY * indexY + m_imageBiasPixelsY * indexX;
 
-		// Store all cols in kernel neighborhood to avoid false-positive corners around seams
-		if ((dstOffsetX > 0) && !isOnSeam(dstOffsetX, false))
+	// Store all cols in kernel neighborhood to avoid false-positive corners around seams
+	if ((dstOffsetX > 0) && !isOnSeam(dstOffsetX, false))
+	{
+		for (size_t col = dstOffsetX - m_deepSmoothingKernelSize; col <= dstOffsetX + m_deepSmoothingKernelSize; col++)
 		{
-			for (size_t col = dstOffsetX - deepSmoothingKernelSize; col <= dstOffsetX + deepSmoothingKernelSize; col++)
-			{
-				m_seamCols.push_back(col);
-			}
+			m_seamCols.push_back(col);
 		}
+	}
 
-		// Store all rows in kernel neighborhood to avoid false-positive corners around seams
-		if ((dstOffsetY > 0) && !isOnSeam(dstOffsetY, true))
+	// Store all rows in kernel neighborhood to avoid false-positive corners around seams
+	if ((dstOffsetY > 0) && !isOnSeam(dstOffsetY, true))
+	{
+		for (size_t row = dstOffsetY - m_deepSmoothingKernelSize; row <= dstOffsetY + m_deepSmoothingKernelSize; row++)
 		{
-			for (size_t row = dstOffsetY - deepSmoothingKernelSize; row <= dstOffsetY + deepSmoothingKernelSize; row++)
-			{
-				m_seamRows.push_back(row);
-			}
+			m_seamRows.push_back(row);
 		}
-
-		// Frame width is non-onerlapped vertical area for all frames before last or whole last frame
-		size_t frameW = (indexX < m_indexedPositionsX.size() - 1) ?
-			stepPixelsX :
-			(size_t)(m_imageFrameRelativeW * images[imageIndex].cols);
-
-		// Frame height is non-onerlapped horizontal area for all frames before last or whole last frame
-		size_t frameH = (indexY < m_indexedPositionsY.size() - 1) ?
-			stepPixelsY :
-			(size_t)(m_imageFrameRelativeH * images[imageIndex].rows);
-
-		// Select destination layer according to z
-		size_t layerIndex = m_indexedPositionsZ[z];
-		ByteMatrix& dstMatrix = m_layers[layerIndex].matrix;
-
-		// Copy pixels from source to destination matrix
-		stitchSingleImage(dstMatrix, images[imageIndex], dstOffsetX, dstOffsetY, frameW, frameH);
 	}
 }
 
@@ -442,8 +714,8 @@ void Map::markCorners(ByteMatrix& matrix, std::vector<ScoredCorner>& scoredCorne
 	for (const ScoredCorner& scoredCorner : scoredCorners)
 	{
 		// Convert position of the corner from mm to pixels
-		size_t cornerRow = mm2pixels(scoredCorner.y);
-		size_t cornerCol = mm2pixels(scoredCorner.x);
+		size_t cornerRow = mm2pixels(scoredCorner.y, m_pixelsInMm);
+		size_t cornerCol = mm2pixels(scoredCorner.x, m_pixelsInMm);
 
 		// Limit marker boundaries to not excess the matrix
 		size_t markerRowMin = std::max<size_t>(cornerRow - halfMarkerSize, 0);
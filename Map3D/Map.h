@@ -3,6 +3,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <functional>
 
 #pragma warning(push)
 #pragma warning(disable: 5054)
@@ -11,6 +12,8 @@
 #pragma warning(pop)
 
 #include "Timer.h"
+#include "Job.h"
+#include "Trace.h"
 #include "Point3D.h"
 #include "ByteMatrix.h"
 
@@ -43,6 +46,25 @@ public:
 	}
 };
 
+// Best score of the frame of given size in the capillary with the angle of the frame
+class FrameScore
+{
+public:
+	size_t width;
+	size_t height;
+	float angle;
+	float score;
+
+public:
+	FrameScore(size_t frameWidth, size_t frameHeight, float frameAngle, float frameScore)
+	{
+		width = frameWidth;
+		height = frameHeight;
+		angle = frameAngle;
+		score = frameScore;
+	}
+};
+
 class CapillaryInfo
 {
 public:
@@ -56,9 +78,20 @@ public:
 	size_t energyCapillary;
 	size_t pixelsSurroundings;
 	size_t energySurroundings;
+
+	// Raw moments of pixel positions in the capillary: x is col and y is row
+	size_t momentX;
+	size_t momentY;
+	size_t momentXX;
+	size_t momentXY;
+	size_t momentYY;
+
 	float angle;
 	float score;
 
+	// Scores of all configured frame sizes: the first one is the same as the score above
+	std::vector<FrameScore> frameScores;
+
 public:
 	CapillaryInfo()
 	{
@@ -71,6 +104,11 @@ public:
 		energyCapillary = 0;
 		pixelsSurroundings = 0;
 		energySurroundings = 0;
+		momentX = 0;
+		momentY = 0;
+		momentXX = 0;
+		momentXY = 0;
+		momentYY = 0;
 		angle = 0.0F;
 		score = 0.0F;
 	}
@@ -81,6 +119,29 @@ public:
 		posApex.y = scoredCorner.y;
 		posApex.z = scoredCorner.z;
 	}
+
+	// Angle of the principal axis from axis X in radians: in range [0, PI) with axis Y along rows
+	float getPrincipalAxisAngle()
+	{
+		if (pixelsCapillary == 0)
+		{
+			return 0.0F;
+		}
+
+		// Central second order moments calculated from the raw moments
+		double meanX = (double)momentX / pixelsCapillary;
+		double meanY = (double)momentY / pixelsCapillary;
+		double centralXX = (double)momentXX / pixelsCapillary - meanX * meanX;
+		double centralXY = (double)momentXY / pixelsCapillary - meanX * meanY;
+		double centralYY = (double)momentYY / pixelsCapillary - meanY * meanY;
+
+		double axisAngle = 0.5 * std::atan2(2.0 * centralXY, centralXX - centralYY);
+		if (axisAngle < 0.0)
+		{
+			axisAngle += std::numbers::pi;
+		}
+		return (float)axisAngle;
+	}
 };
 
 class LayerInfo
@@ -108,7 +169,19 @@ public:
 	Map();
 	~Map() = default;
 
-	void buildMap(const std::string& folderName, Config& config);
+	void buildMap(const std::string& folderName, const ConfigSnapshot& config, JobControl& control);
+
+	// Map built by layers: only stitching modifies the map, so completed layers can be read concurrently
+	size_t prepareLayers(const std::string& folderName, const ConfigSnapshot& config);
+	void stitchLayers(const std::string& folderName, JobControl& control,
+		const std::function<bool(size_t layerIndex)>& onLayerStitched);
+
+	// Live scan: tiles are stitched as they arrive - not concurrently with other stages of the map
+	void beginTileScan(const ConfigSnapshot& config, float startX, float startY, float stepX, float stepY,
+		size_t countX, size_t countY, size_t tileRows, size_t tileCols);
+	void addTile(const byte* pixels, size_t rows, size_t cols, size_t stride, float x, float y, float z);
+	void finalizeTileScan();
+
 	void printValueAtTruncatedPos(float x, float y, float z);
 	void saveStiched(std::vector<LayerInfo>& layersWithCapillaries, const std::string& outputFolderName);
 	bool isOnSeam(size_t posPixels, bool isRow);
@@ -118,12 +191,14 @@ public:
 
 private:
 	std::vector<Layer> m_layers;
+	std::vector<std::vector<std::string>> m_scanPositions;
 
 	std::map<float, size_t> m_indexedPositionsX;
 	std::map<float, size_t> m_indexedPositionsY;
 	std::map<float, size_t> m_indexedPositionsZ;
 
 	// Parameters from configuration
+	size_t m_pixelsInMm;
 	std::string m_scanPosFilename;
 	size_t m_markerCornerSize;
 	size_t m_imageBiasPixelsX;
@@ -132,6 +207,8 @@ private:
 	float m_imageMarginRelativeY;
 	float m_imageFrameRelativeW;
 	float m_imageFrameRelativeH;
+	float m_toleranceZmm;
+	size_t m_deepSmoothingKernelSize;
 
 	float m_startXmm;
 	float m_startYmm;
@@ -145,16 +222,30 @@ private:
 	std::vector<size_t> m_seamRows;
 	std::vector<size_t> m_seamCols;
 
+	// State of the live scan
+	size_t m_tileRows;
+	size_t m_tileCols;
+	size_t m_tilesNum;
+	bool m_isTileScanOpen;
+
+	// Stitched positions of the scan grid in each layer of the live scan
+	std::vector<std::vector<bool>> m_stitchedTiles;
+
 	Timer m_timer;
 
 private:
-	void initConfig(Config& config);
+	void initConfig(const ConfigSnapshot& config);
 	std::vector<std::vector<std::string>> readScanPositions(const std::string& folderName);
 	std::map<float, size_t> getUniqueIndexedPositions(const std::vector<std::string>& coords);
-	std::vector<cv::Mat> readImages(const std::string& folderName);
+	std::vector<cv::Mat> readImages(const std::string& folderName, JobControl& control);
+	cv::Mat readImage(const std::string& folderName, size_t fileIndex);
+	void clearLayers();
 	void initLayers(const cv::Mat& firstImage);
+	void initLayerSize(size_t imageRows, size_t imageCols);
 	void stitchImages(const std::vector<std::vector<std::string>>& scanPositions,
-		const std::vector<cv::Mat>& images, size_t deepSmoothingKernelSize);
+		const std::vector<cv::Mat>& images, JobControl& control);
+	void stitchTile(ByteMatrix& dstMatrix, const cv::Mat& srcImage, size_t indexX, size_t indexY);
+	void addSeams(size_t indexX, size_t indexY);
 	void stitchSingleImage(ByteMatrix& dstMatrix, const cv::Mat& srcImage,
 		const size_t dstOffsetX, const size_t dstOffsetY, const size_t frameW, const size_t frameH);
 	void copyScanPosFile(const std::string& scanPosFolderName, const std::string& outputFolderName);
@@ -1,151 +1,387 @@
 #include "Map3D.h"
 
-Config config;
-Map map;
-LayerScanner layerScanner;
-std::vector<LayerInfo> layersWithCapillaries;
-CapillaryProcessor capillaryProcessor;
-LineImageProcessor lineImageProcessor;
-WideImageProcessor wideImageProcessor;
-SpectrumAnalyzer spectrumAnalyzer;
-Sequence sequence;
-std::vector<float> positionsZ;
+// Session of callers of the functions without the handle
+Session defaultSession;
 
 
 void loadConfig(const char* configFilename)
 {
-	bool loadResult = config.load(configFilename);
-	if (!loadResult)
-	{
-		std::cout << "Cannot load config file: " << configFilename << std::endl << std::endl;
-	}
+	sessionLoadConfig(&defaultSession, configFilename);
 }
 
 void initGeneralData()
 {
-	initGeneralData(config);
+	defaultSession.initGeneralData();
 }
 
 void buildMap()
 {
-	std::string inputFolderNameMap = config.getStringValue(keyInputMapFolder);
-	map.buildMap(inputFolderNameMap, config);
+	sessionBuildMap(&defaultSession);
+}
+
+void beginTileScan(float startX, float startY, float stepX, float stepY, int countX, int countY,
+	int tileRows, int tileCols)
+{
+	sessionBeginTileScan(&defaultSession, startX, startY, stepX, stepY, countX, countY, tileRows, tileCols);
+}
+
+void addTile(const unsigned char* pixels, int rows, int cols, int stride, float x, float y, float z)
+{
+	sessionAddTile(&defaultSession, pixels, rows, cols, stride, x, y, z);
+}
+
+void finalizeTileScan()
+{
+	sessionFinalizeTileScan(&defaultSession);
 }
 
 void printValueAtTruncatedPos(float x, float y, float z)
 {
-	map.printValueAtTruncatedPos(x, y, z);
+	sessionPrintValueAtTruncatedPos(&defaultSession, x, y, z);
 }
 
 void saveStiched()
 {
-	std::string outputFolderNameMap = config.getStringValue(keyOutputMapFolder);
-	map.saveStiched(layersWithCapillaries, outputFolderNameMap);
+	sessionSaveStiched(&defaultSession);
 }
 
 void detectCapillaries()
 {
-	std::string outputFolderNameMap = config.getStringValue(keyOutputMapFolder);
-	layersWithCapillaries = layerScanner.detectCapillaries(map, outputFolderNameMap, config);
+	sessionDetectCapillaries(&defaultSession);
 }
 
 void describeCapillaries()
 {
-	std::string outputFolderNameMap = config.getStringValue(keyOutputMapFolder);
-	if (layersWithCapillaries.empty())
-	{
-		std::cout << "No layers with enough capillaries are found" << std::endl << std::endl;
-		return;
-	}
-#ifdef _DEBUG
-	// Create and init file containing data of all layers
-	std::string filenameAllLayers = outputFolderNameMap + "/Capillaries/ActualLayersFrames.csv";
-	std::ofstream fileAllLayers(filenameAllLayers);
-	fileAllLayers << "Layer,Frames,Max score,Sum score" << std::endl;
-#endif
-	capillaryProcessor.init(config);
-	size_t bestLayerIndex = 0;
-	float bestLayerSumScore = 0.0F;
-	for (LayerInfo& layerInfo : layersWithCapillaries)
-	{
-		capillaryProcessor.describeCapillaries(map, layerInfo, outputFolderNameMap);
-#ifdef _DEBUG
-		std::string printedLine =
-			std::to_string(layerInfo.layerIndex + 1) + "," +
-			std::to_string(layerInfo.capillariesInfo.size()) + "," +
-			toString(layerInfo.maxScore, 1) + "," +
-			toString(layerInfo.sumScore, 1);
-		fileAllLayers << printedLine << std::endl;
-#endif
-		if (layerInfo.sumScore > bestLayerSumScore)
-		{
-			bestLayerIndex = layerInfo.layerIndex;
-			bestLayerSumScore = layerInfo.sumScore;
-		}
-	}
-	std::cout << "Best layer: " << bestLayerIndex + 1 << std::endl << std::endl;
-	std::string filenameSummary = outputFolderNameMap + "/Summary.txt";
-	std::ofstream fileSummary(filenameSummary);
-	fileSummary << "Best layer: " << bestLayerIndex + 1 << std::endl;
-	fileSummary.close();
-#ifdef _DEBUG
-	fileAllLayers.close();
-#endif
+	sessionDescribeCapillaries(&defaultSession);
+}
+
+void sweepParameters(const char* grid)
+{
+	sessionSweepParameters(&defaultSession, grid);
+}
+
+void processMap()
+{
+	sessionProcessMap(&defaultSession);
 }
 
 void loadPositionsZ()
 {
-	std::string inputFolderNameLock = config.getStringValue(keyInputLockFolder);
-	positionsZ = sequence.loadPositionsZ(inputFolderNameLock, config);
+	sessionLoadPositionsZ(&defaultSession);
 }
 
 void buildSequence()
 {
-	std::string inputFolderNameLock = config.getStringValue(keyInputLockFolder);
-	sequence.buildSequence(inputFolderNameLock, config);
+	sessionBuildSequence(&defaultSession);
 }
 
 void saveProjections()
 {
-	std::string outputFolderNameLock = config.getStringValue(keyOutputLockFolder);
-	sequence.saveProjections(outputFolderNameLock);
+	sessionSaveProjections(&defaultSession);
 }
 
 void calculateDepth()
 {
-	std::string inputFolderNameLock = config.getStringValue(keyInputLockFolder);
-	std::string outputFolderNameLock = config.getStringValue(keyOutputLockFolder);
-	std::string focusingMethod = config.getStringValue(keyFocusingMethod);
+	sessionCalculateDepth(&defaultSession);
+}
+
+void validateCalibration()
+{
+	sessionValidateCalibration(&defaultSession);
+}
+
+void initFocusLock()
+{
+	sessionInitFocusLock(&defaultSession);
+}
+
+void loadFocusLockCalibration(const char* calibrationFilename)
+{
+	sessionLoadFocusLockCalibration(&defaultSession, calibrationFilename);
+}
 
-	if (focusingMethod == "Mode")
-	{
-		wideImageProcessor.calculateStatistics(inputFolderNameLock, outputFolderNameLock,
-			positionsZ, ImageMarkerType::GRAY_LEVEL_MODE, config);
-	}
+void setFocusLockCalibration(float slope, float offset)
+{
+	sessionSetFocusLockCalibration(&defaultSession, slope, offset);
+}
 
-	if (focusingMethod == "Variance")
-	{
-		wideImageProcessor.calculateStatistics(inputFolderNameLock, outputFolderNameLock,
-			positionsZ, ImageMarkerType::GRAY_LEVEL_VARIANCE, config);
-	}
+float processFocusLockFrame(const unsigned char* pixels, int rows, int cols, int stride)
+{
+	return sessionProcessFocusLockFrame(&defaultSession, pixels, rows, cols, stride);
+}
 
-	if (focusingMethod == "Spectrum")
-	{
-		spectrumAnalyzer.calculateSpectrum(inputFolderNameLock, outputFolderNameLock, positionsZ);
-	}
+void getFocusLockLatency(int* framesNum, double* p50, double* p90, double* p99, double* max)
+{
+	sessionGetFocusLockLatency(&defaultSession, framesNum, p50, p90, p99, max);
 }
 
 void overrideInt(const char* key, int val)
 {
-	config.setOverride(key, val);
+	sessionOverrideInt(&defaultSession, key, val);
 }
 
 void overrideFloat(const char* key, float val)
 {
-	config.setOverride(key, val);
+	sessionOverrideFloat(&defaultSession, key, val);
 }
 
 void overrideString(const char* key, const char* val)
 {
-	config.setOverride(key, val);
+	sessionOverrideString(&defaultSession, key, val);
+}
+
+Job* buildMapAsync(ProgressCallback callback, void* userData)
+{
+	return sessionBuildMapAsync(&defaultSession, callback, userData);
+}
+
+Job* detectCapillariesAsync(ProgressCallback callback, void* userData)
+{
+	return sessionDetectCapillariesAsync(&defaultSession, callback, userData);
+}
+
+Job* describeCapillariesAsync(ProgressCallback callback, void* userData)
+{
+	return sessionDescribeCapillariesAsync(&defaultSession, callback, userData);
+}
+
+Job* processMapAsync(ProgressCallback callback, void* userData)
+{
+	return sessionProcessMapAsync(&defaultSession, callback, userData);
+}
+
+Job* calculateDepthAsync(ProgressCallback callback, void* userData)
+{
+	return sessionCalculateDepthAsync(&defaultSession, callback, userData);
+}
+
+Session* createSession()
+{
+	return new Session();
+}
+
+void destroySession(Session* session)
+{
+	delete session;
+}
+
+void sessionLoadConfig(Session* session, const char* configFilename)
+{
+	session->loadConfig(configFilename);
+}
+
+void sessionOverrideInt(Session* session, const char* key, int val)
+{
+	session->setOverride(key, val);
+}
+
+void sessionOverrideFloat(Session* session, const char* key, float val)
+{
+	session->setOverride(key, val);
+}
+
+void sessionOverrideString(Session* session, const char* key, const char* val)
+{
+	session->setOverride(key, std::string(val));
+}
+
+void sessionBuildMap(Session* session)
+{
+	session->runStage([session](JobControl& control) { session->buildMap(control); });
+}
+
+void sessionBeginTileScan(Session* session, float startX, float startY, float stepX, float stepY,
+	int countX, int countY, int tileRows, int tileCols)
+{
+	session->beginTileScan(startX, startY, stepX, stepY, countX, countY, tileRows, tileCols);
+}
+
+void sessionAddTile(Session* session, const unsigned char* pixels, int rows, int cols, int stride,
+	float x, float y, float z)
+{
+	session->addTile(pixels, rows, cols, stride, x, y, z);
+}
+
+void sessionFinalizeTileScan(Session* session)
+{
+	session->finalizeTileScan();
+}
+
+void sessionPrintValueAtTruncatedPos(Session* session, float x, float y, float z)
+{
+	session->printValueAtTruncatedPos(x, y, z);
+}
+
+void sessionSaveStiched(Session* session)
+{
+	session->saveStiched();
+}
+
+void sessionDetectCapillaries(Session* session)
+{
+	session->runStage([session](JobControl& control) { session->detectCapillaries(control); });
+}
+
+void sessionDescribeCapillaries(Session* session)
+{
+	session->runStage([session](JobControl& control) { session->describeCapillaries(control); });
+}
+
+void sessionSweepParameters(Session* session, const char* grid)
+{
+	std::string sweptGrid = grid;
+	session->runStage([session, &sweptGrid](JobControl& control) { session->sweepParameters(sweptGrid, control); });
+}
+
+void sessionProcessMap(Session* session)
+{
+	session->runStage([session](JobControl& control) { session->processMap(control); });
+}
+
+int sessionGetLayersNum(Session* session)
+{
+	return (int)session->getLayersNum();
+}
+
+int sessionGetBestLayerIndex(Session* session)
+{
+	return session->getBestLayerIndex();
+}
+
+void sessionLoadPositionsZ(Session* session)
+{
+	session->loadPositionsZ();
+}
+
+void sessionBuildSequence(Session* session)
+{
+	session->buildSequence();
+}
+
+void sessionSaveProjections(Session* session)
+{
+	session->saveProjections();
+}
+
+void sessionCalculateDepth(Session* session)
+{
+	session->runStage([session](JobControl& control) { session->calculateDepth(control); });
+}
+
+void sessionValidateCalibration(Session* session)
+{
+	session->runStage([session](JobControl& control) { session->validateCalibration(control); });
+}
+
+void sessionInitFocusLock(Session* session)
+{
+	session->initFocusLock();
+}
+
+void sessionLoadFocusLockCalibration(Session* session, const char* calibrationFilename)
+{
+	session->loadFocusLockCalibration(calibrationFilename);
+}
+
+void sessionSetFocusLockCalibration(Session* session, float slope, float offset)
+{
+	session->setFocusLockCalibration(slope, offset);
+}
+
+float sessionProcessFocusLockFrame(Session* session, const unsigned char* pixels, int rows, int cols, int stride)
+{
+	return session->processFocusLockFrame(pixels, rows, cols, stride);
+}
+
+void sessionGetFocusLockLatency(Session* session, int* framesNum, double* p50, double* p90, double* p99, double* max)
+{
+	LatencyPercentiles percentiles = session->getFocusLockLatency();
+	*framesNum = (int)percentiles.framesNum;
+	*p50 = percentiles.p50;
+	*p90 = percentiles.p90;
+	*p99 = percentiles.p99;
+	*max = percentiles.max;
+}
+
+Job* sessionBuildMapAsync(Session* session, ProgressCallback callback, void* userData)
+{
+	return session->startJob([session](JobControl& control) { session->buildMap(control); }, callback, userData);
+}
+
+Job* sessionDetectCapillariesAsync(Session* session, ProgressCallback callback, void* userData)
+{
+	return session->startJob([session](JobControl& control) { session->detectCapillaries(control); },
+		callback, userData);
+}
+
+Job* sessionDescribeCapillariesAsync(Session* session, ProgressCallback callback, void* userData)
+{
+	return session->startJob([session](JobControl& control) { session->describeCapillaries(control); },
+		callback, userData);
+}
+
+Job* sessionProcessMapAsync(Session* session, ProgressCallback callback, void* userData)
+{
+	return session->startJob([session](JobControl& control) { session->processMap(control); },
+		callback, userData);
+}
+
+Job* sessionSweepParametersAsync(Session* session, const char* grid, ProgressCallback callback, void* userData)
+{
+	std::string sweptGrid = grid;
+	return session->startJob([session, sweptGrid](JobControl& control) { session->sweepParameters(sweptGrid, control); },
+		callback, userData);
+}
+
+Job* sessionCalculateDepthAsync(Session* session, ProgressCallback callback, void* userData)
+{
+	return session->startJob([session](JobControl& control) { session->calculateDepth(control); },
+		callback, userData);
+}
+
+Job* sessionValidateCalibrationAsync(Session* session, ProgressCallback callback, void* userData)
+{
+	return session->startJob([session](JobControl& control) { session->validateCalibration(control); },
+		callback, userData);
+}
+
+void cancelJob(Job* job)
+{
+	job->cancel();
+}
+
+int waitJob(Job* job)
+{
+	return (int)job->wait();
+}
+
+int getJobStatus(Job* job)
+{
+	return (int)job->getStatus();
+}
+
+// Message is valid until the job is destroyed
+const char* getJobError(Job* job)
+{
+	return job->getError().c_str();
+}
+
+void destroyJob(Job* job)
+{
+	delete job;
+}
+
+void startTracing()
+{
+	Tracer::start();
+}
+
+void stopTracing()
+{
+	Tracer::stop();
+}
+
+void saveTrace(const char* traceFilename)
+{
+	Tracer::saveChromeTrace(traceFilename);
 }
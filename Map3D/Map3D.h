@@ -1,27 +1,100 @@
 #pragma once
 
 #include "MapAPI.h"
-#include "LayerScanner.h"
-#include "CapillaryProcessor.h"
-#include "Sequence.h"
-#include "LineImageProcessor.h"
-#include "WideImageProcessor.h"
-#include "SpectrumAnalyzer.h"
+#include "Session.h"
 
 extern "C"
 {
+	// Functions of the default session of the process
 	MAP_API void __cdecl loadConfig(const char* configFilename);
 	MAP_API void __cdecl initGeneralData();
 	MAP_API void __cdecl buildMap();
+	MAP_API void __cdecl beginTileScan(float startX, float startY, float stepX, float stepY, int countX, int countY,
+		int tileRows, int tileCols);
+	MAP_API void __cdecl addTile(const unsigned char* pixels, int rows, int cols, int stride, float x, float y, float z);
+	MAP_API void __cdecl finalizeTileScan();
 	MAP_API void __cdecl printValueAtTruncatedPos(float x, float y, float z);
 	MAP_API void __cdecl saveStiched();
 	MAP_API void __cdecl detectCapillaries();
 	MAP_API void __cdecl describeCapillaries();
+	MAP_API void __cdecl sweepParameters(const char* grid);
+	MAP_API void __cdecl processMap();
 	MAP_API void __cdecl loadPositionsZ();
 	MAP_API void __cdecl buildSequence();
 	MAP_API void __cdecl saveProjections();
 	MAP_API void __cdecl calculateDepth();
+	MAP_API void __cdecl validateCalibration();
+	MAP_API void __cdecl initFocusLock();
+	MAP_API void __cdecl loadFocusLockCalibration(const char* calibrationFilename);
+	MAP_API void __cdecl setFocusLockCalibration(float slope, float offset);
+	MAP_API float __cdecl processFocusLockFrame(const unsigned char* pixels, int rows, int cols, int stride);
+	MAP_API void __cdecl getFocusLockLatency(int* framesNum, double* p50, double* p90, double* p99, double* max);
 	MAP_API void __cdecl overrideInt(const char* key, int val);
 	MAP_API void __cdecl overrideFloat(const char* key, float val);
 	MAP_API void __cdecl overrideString(const char* key, const char* val);
-}
\ No newline at end of file
+	MAP_API Job* __cdecl buildMapAsync(ProgressCallback callback, void* userData);
+	MAP_API Job* __cdecl detectCapillariesAsync(ProgressCallback callback, void* userData);
+	MAP_API Job* __cdecl describeCapillariesAsync(ProgressCallback callback, void* userData);
+	MAP_API Job* __cdecl processMapAsync(ProgressCallback callback, void* userData);
+	MAP_API Job* __cdecl calculateDepthAsync(ProgressCallback callback, void* userData);
+
+	// Functions of sessions created by the caller - the handle is opaque and owns all state of the session
+	MAP_API Session* __cdecl createSession();
+	MAP_API void __cdecl destroySession(Session* session);
+	MAP_API void __cdecl sessionLoadConfig(Session* session, const char* configFilename);
+	MAP_API void __cdecl sessionOverrideInt(Session* session, const char* key, int val);
+	MAP_API void __cdecl sessionOverrideFloat(Session* session, const char* key, float val);
+	MAP_API void __cdecl sessionOverrideString(Session* session, const char* key, const char* val);
+	MAP_API void __cdecl sessionBuildMap(Session* session);
+
+	// Live scan: tiles are stitched to the map of the session as they arrive from the camera,
+	// the buffer of the tile is not retained and no other stage of the session can run until finalization
+	MAP_API void __cdecl sessionBeginTileScan(Session* session, float startX, float startY, float stepX, float stepY,
+		int countX, int countY, int tileRows, int tileCols);
+	MAP_API void __cdecl sessionAddTile(Session* session, const unsigned char* pixels, int rows, int cols, int stride,
+		float x, float y, float z);
+	MAP_API void __cdecl sessionFinalizeTileScan(Session* session);
+
+	MAP_API void __cdecl sessionPrintValueAtTruncatedPos(Session* session, float x, float y, float z);
+	MAP_API void __cdecl sessionSaveStiched(Session* session);
+	MAP_API void __cdecl sessionDetectCapillaries(Session* session);
+	MAP_API void __cdecl sessionDescribeCapillaries(Session* session);
+	MAP_API void __cdecl sessionSweepParameters(Session* session, const char* grid);
+	MAP_API void __cdecl sessionProcessMap(Session* session);
+	MAP_API int __cdecl sessionGetLayersNum(Session* session);
+	MAP_API int __cdecl sessionGetBestLayerIndex(Session* session);
+	MAP_API void __cdecl sessionLoadPositionsZ(Session* session);
+	MAP_API void __cdecl sessionBuildSequence(Session* session);
+	MAP_API void __cdecl sessionSaveProjections(Session* session);
+	MAP_API void __cdecl sessionCalculateDepth(Session* session);
+	MAP_API void __cdecl sessionValidateCalibration(Session* session);
+	MAP_API void __cdecl sessionInitFocusLock(Session* session);
+	MAP_API void __cdecl sessionLoadFocusLockCalibration(Session* session, const char* calibrationFilename);
+	MAP_API void __cdecl sessionSetFocusLockCalibration(Session* session, float slope, float offset);
+	MAP_API float __cdecl sessionProcessFocusLockFrame(Session* session,
+		const unsigned char* pixels, int rows, int cols, int stride);
+	MAP_API void __cdecl sessionGetFocusLockLatency(Session* session,
+		int* framesNum, double* p50, double* p90, double* p99, double* max);
+
+	// Stages running on own thread with progress reported by the callback (can be null) - the job is destroyed
+	// by the caller after it is finished, the session must not be destroyed while its job is running
+	MAP_API Job* __cdecl sessionBuildMapAsync(Session* session, ProgressCallback callback, void* userData);
+	MAP_API Job* __cdecl sessionDetectCapillariesAsync(Session* session, ProgressCallback callback, void* userData);
+	MAP_API Job* __cdecl sessionDescribeCapillariesAsync(Session* session, ProgressCallback callback, void* userData);
+	MAP_API Job* __cdecl sessionProcessMapAsync(Session* session, ProgressCallback callback, void* userData);
+	MAP_API Job* __cdecl sessionSweepParametersAsync(Session* session, const char* grid,
+		ProgressCallback callback, void* userData);
+	MAP_API Job* __cdecl sessionCalculateDepthAsync(Session* session, ProgressCallback callback, void* userData);
+	MAP_API Job* __cdecl sessionValidateCalibrationAsync(Session* session, ProgressCallback callback, void* userData);
+	MAP_API void __cdecl cancelJob(Job* job);
+	MAP_API int __cdecl waitJob(Job* job);
+	MAP_API int __cdecl getJobStatus(Job* job);
+	MAP_API const char* __cdecl getJobError(Job* job);
+	MAP_API void __cdecl destroyJob(Job* job);
+
+	// Tracing of all sessions of the process - has no effect if the library is built without MAP_TRACING,
+	// the trace is saved when no stage is running
+	MAP_API void __cdecl startTracing();
+	MAP_API void __cdecl stopTracing();
+	MAP_API void __cdecl saveTrace(const char* traceFilename);
+}
@@ -1,3 +1,5 @@
+#include <future>
+
 #include "UtilsCUDA.h"
 #include "MaxRectangle.h"
 
@@ -6,56 +8,13 @@
 	===========================================
 */
 
-__device__ constexpr float PI() { return 3.14159265F; }
-
-__global__ void resetRotatedCapillary(byte* d_dstMatrix, int dstRows, int dstCols)
-{
-	int x = blockIdx.x * blockDim.x + threadIdx.x;
-	int y = blockIdx.y * blockDim.y + threadIdx.y;
-
-	if ((x >= dstCols) || (y >= dstRows))
-	{
-		return;
-	}
-
-	d_dstMatrix[y * dstCols + x] = LIGHT_GRAY;
-}
-
-__global__ void performCapillaryRotation(byte* d_srcMatrix, byte* d_dstMatrix,
-	int srcRows, int srcCols, int dstRows, int dstCols,
-	float srcCenterX, float srcCenterY, float dstCenterX, float dstCenterY, float angle)
-{
-	int x = blockIdx.x * blockDim.x + threadIdx.x;
-	int y = blockIdx.y * blockDim.y + threadIdx.y;
-
-	if ((x >= srcCols) || (y >= srcRows))
-	{
-		return;
-	}
-
-	byte pixel = d_srcMatrix[y * srcCols + x];
-	if (pixel != WHITE)
-	{
-		return;
-	}
-
-	float deltaX = srcCenterX - (float)x;
-	float deltaY = srcCenterY - (float)y;
-	float radius = sqrtf(deltaX * deltaX + deltaY * deltaY);
-	float angleSrc = atan2f(deltaY, deltaX);
-	float angleDst = angleSrc + angle + PI(); // axis Y is counter-directional to rows numeration
-	size_t dstX = (size_t)((int)dstCenterX + (int)round(radius * cosf(angleDst)));
-	size_t dstY = (size_t)((int)dstCenterY + (int)round(radius * sinf(angleDst)));
-	d_dstMatrix[dstY * dstCols + dstX] = pixel;
-}
-
 /*
 	Public Host (CPU) functions to call kernel Device (GPU) functions
 	=================================================================
 */
 
 MaxRectangle::MaxRectangle(ByteMatrix& byteMatrix, PixelPos start, size_t rows, size_t cols,
-	const std::string& layerFolderName, size_t capillaryIndex)
+	const std::string& layerFolderName, size_t capillaryIndex, const RectangleSettings& settings)
 {
 	// Create and fill original rectangle
 	m_originalCapillary = ByteMatrix(rows, cols);
@@ -74,57 +33,58 @@ MaxRectangle::MaxRectangle(ByteMatrix& byteMatrix, PixelPos start, size_t rows,
 		std::to_string(capillaryIndex + 1) + ".bmp";
 	cv::imwrite(capillaryFilename, m_originalCapillary.asCvMatU8());
 #endif
-	// Prepare byte matrices for rotated and dilated rectangle - large enough for any rotation
-	size_t rotatedSize = 2 * std::max(rows, cols);
-	m_rotatedCapillary = ByteMatrix(rotatedSize, rotatedSize);
-	m_dilatedCapillary = ByteMatrix(rotatedSize, rotatedSize);
+	// Size of rotated and dilated rectangle - large enough for any rotation
+	m_rotatedSize = 2 * std::max(rows, cols);
+	m_rotator = CapillaryRotator(m_originalCapillary);
 
 	// Calculate center of updated rectangle which is the same as center of original rectangle
 	size_t centralRow = start.pixelRow + rows / 2;
 	size_t centralCol = start.pixelCol + cols / 2;
 	m_centerInImage = PixelPos(centralRow, centralCol);
 
-	m_limitUp = 0;
-	m_limitDn = 0;
-	m_limitLf = 0;
-	m_limitRt = 0;
-
-	m_rowFrameInRotated = 0;
-	m_colFrameInRotated = 0;
+	m_settings = settings;
+	m_axisAngleRadians = 0.0F;
 	m_foundAngleRadians = 0.0F;
-	m_score = 0.0F;
+	m_bestPlacements.resize(m_settings.frameSizes.size());
+}
+
+void MaxRectangle::setPrincipalAxisAngle(float axisAngleRadians)
+{
+	m_axisAngleRadians = axisAngleRadians;
 }
 
 std::vector<PixelPos> MaxRectangle::findRectangle(const std::string& layerFolderName, size_t capillaryIndex)
 {
+	TRACE_SCOPE("Find rectangle");
 	std::vector<PixelPos> rotatedRectangle;
-	size_t angleDegrees = 0;
-	bool foundInscribedRectangle = false;
-	for (; angleDegrees < 180; angleDegrees += 10)
+	if (m_settings.angleSearchType == AngleSearchType::COARSE_TO_FINE)
 	{
-		rotateCapillary(angleDegrees);
-		findCapillaryLimits();
-		dilateRotatedCapillary();
-		foundInscribedRectangle = findInscribedRectangle();
-		if (foundInscribedRectangle)
-		{
-			break;
-		}
+		searchCoarseToFine();
 	}
+	else if (m_settings.angleSearchType == AngleSearchType::MOMENTS)
+	{
+		searchMoments();
+	}
+	else
+	{
+		searchSequential();
+	}
+	bool foundInscribedRectangle = m_bestRotated.getScore() >= m_settings.scoreThreshold;
 
 #ifdef _DEBUG
 	// Save image of found rotated capillary
 	std::string rotatedFilename = layerFolderName + "/Rotated" +
 		std::to_string(capillaryIndex + 1) + ".bmp";
-	cv::imwrite(rotatedFilename, m_rotatedCapillary.asCvMatU8());
+	cv::imwrite(rotatedFilename, m_bestRotated.rotatedMask.asByteMatrix(WHITE, LIGHT_GRAY).asCvMatU8());
 
 	// Frame is marked only if inscribed rectangle is found
-	markFrameInDilatedCapillary(foundInscribedRectangle);
+	ByteMatrix dilatedImage = m_bestRotated.dilatedMask.asByteMatrix(WHITE, LIGHT_GRAY);
+	markFrameInDilatedCapillary(dilatedImage, foundInscribedRectangle);
 
 	// Save image of found dilated capillary with frame
 	std::string dilatedFilename = layerFolderName + "/Dilated" +
 		std::to_string(capillaryIndex + 1) + ".bmp";
-	cv::imwrite(dilatedFilename, m_dilatedCapillary.asCvMatU8());
+	cv::imwrite(dilatedFilename, dilatedImage.asCvMatU8());
 #endif
 	if (!foundInscribedRectangle)
 	{
@@ -135,7 +95,7 @@ std::vector<PixelPos> MaxRectangle::findRectangle(const std::string& layerFolder
 	writeWidthMap(layerFolderName, capillaryIndex);
 
 	// Convert found angle to radians and flip sign: rotated frame on fixed capillary
-	m_foundAngleRadians = -deg2rad(angleDegrees);
+	m_foundAngleRadians = -deg2rad(m_bestRotated.angleDegrees);
 
 	rotatedRectangle = getRotatedRectangle();
 	return rotatedRectangle;
@@ -148,7 +108,12 @@ float MaxRectangle::getAngle()
 
 float MaxRectangle::getScore()
 {
-	return 100.0F * (m_score - SCORE_THRESHOLD);
+	return 100.0F * (m_bestRotated.getScore() - m_settings.scoreThreshold);
+}
+
+std::vector<FramePlacement> MaxRectangle::getFramePlacements()
+{
+	return m_bestPlacements;
 }
 
 /*
@@ -156,209 +121,221 @@ float MaxRectangle::getScore()
 	==================================================================
 */
 
-void MaxRectangle::rotateCapillary(size_t angleDegrees)
+void MaxRectangle::searchSequential()
 {
-	// Convert given angle to radians
-	float angle = deg2rad(angleDegrees);
-
-	// Sizes of source and destination
-	size_t rowsSrc = m_originalCapillary.rows();
-	size_t colsSrc = m_originalCapillary.cols();
-	size_t rowsDst = m_rotatedCapillary.rows();
-	size_t colsDst = m_rotatedCapillary.cols();
-
-	// Centers of source and destination
-	size_t centerRowSrc = rowsSrc / 2;
-	size_t centerColSrc = colsSrc / 2;
-	size_t centerRowDst = rowsDst / 2;
-	size_t centerColDst = colsDst / 2;
-
-	// Allocate device memory buffers
-	byte* d_srcBuffer = nullptr;
-	checkCuda(cudaMalloc(&d_srcBuffer, rowsSrc * colsSrc));
-	byte* d_dstBuffer = nullptr;
-	checkCuda(cudaMalloc(&d_dstBuffer, rowsDst * colsDst));
-
-	// Parameters to launch parallel threads
-	dim3 blockSize(128, 1);
-	dim3 numBlocksSrc(divideCeil((int)colsSrc, blockSize.x), divideCeil((int)rowsSrc, blockSize.y), 1);
-	dim3 numBlocksDst(divideCeil((int)colsDst, blockSize.x), divideCeil((int)rowsDst, blockSize.y), 1);
-
-	// Fill source device buffer by original capillary
-	checkCuda(cudaMemcpy(d_srcBuffer, m_originalCapillary.getBuffer(), rowsSrc * colsSrc, cudaMemcpyHostToDevice));
-
-	// Fill background of rotated capillary
-	resetRotatedCapillary<<<numBlocksDst, blockSize>>>(d_dstBuffer, (int)rowsDst, (int)colsDst);
-
-	// Calculate rotated capillary on GPU
-	performCapillaryRotation<<<numBlocksSrc, blockSize>>>(d_srcBuffer, d_dstBuffer,
-		(int)rowsSrc, (int)colsSrc, (int)rowsDst, (int)colsDst,
-		(float)centerColSrc, (float)centerRowSrc, (float)centerColDst, (float)centerRowDst, angle);
-	checkCuda(cudaDeviceSynchronize());
-
-	// Get calculated rotated capillary from device memory and free it
-	checkCuda(cudaMemcpy(m_rotatedCapillary.getBuffer(), d_dstBuffer, rowsDst * colsDst, cudaMemcpyDeviceToHost));
-	checkCuda(cudaFree(d_dstBuffer));
+	// Examine coarse angles one by one and stop on the first angle with score over the threshold
+	for (size_t angleDegrees = 0; angleDegrees < HALF_CIRCLE_DEGREES; angleDegrees += COARSE_ANGLE_STEP)
+	{
+		RotatedCapillary rotated = evaluateAngle(angleDegrees);
+		selectBest(rotated, angleDegrees == 0);
+		if (m_bestRotated.getScore() >= m_settings.scoreThreshold)
+		{
+			break;
+		}
+	}
 }
 
-void MaxRectangle::findCapillaryLimits()
+void MaxRectangle::searchCoarseToFine()
 {
-	// Used to break nested loops
-	bool found;
+	// Examine all coarse angles in parallel and select the best scored one
+	std::vector<size_t> coarseAngles;
+	for (size_t angleDegrees = 0; angleDegrees < HALF_CIRCLE_DEGREES; angleDegrees += COARSE_ANGLE_STEP)
+	{
+		coarseAngles.push_back(angleDegrees);
+	}
+	for (RotatedCapillary& rotated : evaluateAngles(coarseAngles))
+	{
+		selectBest(rotated, rotated.angleDegrees == 0);
+	}
 
-	// Find limit: Up
-	found = false;
-	for (size_t row = 0; (row < m_rotatedCapillary.rows()) && !found; row++)
+	// Examine fine angles around the best coarse angle in parallel - angles are cyclic in half circle
+	std::vector<size_t> fineAngles;
+	size_t bestCoarseAngle = m_bestRotated.angleDegrees;
+	for (size_t delta = FINE_ANGLE_STEP; delta < COARSE_ANGLE_STEP; delta += FINE_ANGLE_STEP)
 	{
-		for (size_t col = 0; (col < m_rotatedCapillary.cols()) && !found; col++)
-		{
-			byte pixel = m_rotatedCapillary.get(row, col);
-			if (pixel == WHITE)
-			{
-				m_limitUp = row;
-				found = true;
-			}
-		}
+		fineAngles.push_back((bestCoarseAngle + delta) % HALF_CIRCLE_DEGREES);
+		fineAngles.push_back((bestCoarseAngle + HALF_CIRCLE_DEGREES - delta) % HALF_CIRCLE_DEGREES);
+	}
+	for (RotatedCapillary& rotated : evaluateAngles(fineAngles))
+	{
+		selectBest(rotated, false);
 	}
+}
 
-	// Find limit: Rt
-	found = false;
-	for (size_t col = m_rotatedCapillary.cols() - 1; (col > 0) && !found; col--)
+void MaxRectangle::searchMoments()
+{
+	// Rotation that makes the principal axis vertical: along the height of the frame
+	size_t axisAngleDegrees = rad2deg(m_axisAngleRadians);
+	size_t estimatedAngle = (HALF_CIRCLE_DEGREES + HALF_CIRCLE_DEGREES / 2 - axisAngleDegrees) % HALF_CIRCLE_DEGREES;
+
+	// Single rotation by the estimated angle is enough for most capillaries
+	RotatedCapillary estimated = evaluateAngle(estimatedAngle);
+	selectBest(estimated, true);
+	if (m_bestRotated.getScore() >= m_settings.scoreThreshold)
 	{
-		for (size_t row = 0; (row < m_rotatedCapillary.rows()) && !found; row++)
-		{
-			byte pixel = m_rotatedCapillary.get(row, col);
-			if (pixel == WHITE)
-			{
-				m_limitRt = col;
-				found = true;
-			}
-		}
+		return;
 	}
 
-	// Find limit: Dn
-	found = false;
-	for (size_t row = m_rotatedCapillary.rows() - 1; (row > 0) && !found; row--)
+	// Refine by fine angles in narrow window around the estimated angle in parallel
+	std::vector<size_t> fineAngles;
+	for (size_t delta = FINE_ANGLE_STEP; delta <= MOMENTS_ANGLE_WINDOW; delta += FINE_ANGLE_STEP)
 	{
-		for (size_t col = m_rotatedCapillary.cols() - 1; (col > 0) && !found; col--)
-		{
-			byte pixel = m_rotatedCapillary.get(row, col);
-			if (pixel == WHITE)
-			{
-				m_limitDn = row;
-				found = true;
-			}
-		}
+		fineAngles.push_back((estimatedAngle + delta) % HALF_CIRCLE_DEGREES);
+		fineAngles.push_back((estimatedAngle + HALF_CIRCLE_DEGREES - delta) % HALF_CIRCLE_DEGREES);
 	}
+	for (RotatedCapillary& rotated : evaluateAngles(fineAngles))
+	{
+		selectBest(rotated, false);
+	}
+}
 
-	// Find limit: Lf
-	found = false;
-	for (size_t col = 0; (col < m_rotatedCapillary.cols()) && !found; col++)
+void MaxRectangle::selectBest(RotatedCapillary& rotated, bool isFirst)
+{
+	// Rotation is selected by the main frame size
+	if (isFirst || (rotated.getScore() > m_bestRotated.getScore()))
 	{
-		for (size_t row = m_rotatedCapillary.rows() - 1; (row > 0) && !found; row--)
+		m_bestRotated = rotated;
+	}
+
+	// Each frame size keeps its own best placement independently of the selected rotation
+	for (size_t sizeIndex = 0; sizeIndex < m_bestPlacements.size(); sizeIndex++)
+	{
+		if (isFirst || (rotated.placements[sizeIndex].score > m_bestPlacements[sizeIndex].score))
 		{
-			byte pixel = m_rotatedCapillary.get(row, col);
-			if (pixel == WHITE)
-			{
-				m_limitLf = col;
-				found = true;
-			}
+			m_bestPlacements[sizeIndex] = rotated.placements[sizeIndex];
 		}
 	}
 }
 
-void MaxRectangle::dilateRotatedCapillary()
+std::vector<RotatedCapillary> MaxRectangle::evaluateAngles(const std::vector<size_t>& anglesDegrees)
+{
+	TRACE_SCOPE("Angle search");
+	// Each angle is evaluated on own rotated and dilated matrices - no shared state between tasks
+	std::vector<std::future<RotatedCapillary>> futures;
+	for (size_t angleDegrees : anglesDegrees)
+	{
+		futures.push_back(std::async(std::launch::async, &MaxRectangle::evaluateAngle, this, angleDegrees));
+	}
+
+	std::vector<RotatedCapillary> rotatedCapillaries;
+	for (std::future<RotatedCapillary>& future : futures)
+	{
+		rotatedCapillaries.push_back(future.get());
+	}
+	return rotatedCapillaries;
+}
+
+RotatedCapillary MaxRectangle::evaluateAngle(size_t angleDegrees)
+{
+	TRACE_SCOPE("Evaluate angle");
+	RotatedCapillary rotated;
+	rotated.angleDegrees = angleDegrees;
+	rotated.rotatedMask = BitMatrix(m_rotatedSize, m_rotatedSize);
+	rotated.dilatedMask = BitMatrix(m_rotatedSize, m_rotatedSize);
+	rotated.placements.resize(m_settings.frameSizes.size());
+	for (FramePlacement& placement : rotated.placements)
+	{
+		placement.angleDegrees = angleDegrees;
+	}
+
+	// Rotation records limits of the rotated capillary in the same pass
+	RotationLimits limits = m_rotator.rotate(angleDegrees, rotated.rotatedMask);
+	if (!limits.found)
+	{
+		return rotated;
+	}
+	rotated.limitUp = limits.limitUp;
+	rotated.limitDn = limits.limitDn;
+	rotated.limitLf = limits.limitLf;
+	rotated.limitRt = limits.limitRt;
+
+	dilateRotatedCapillary(rotated);
+	findInscribedRectangles(rotated);
+	return rotated;
+}
+
+void MaxRectangle::dilateRotatedCapillary(RotatedCapillary& rotated)
 {
 	const size_t dilationKernelSize = 3;
-	size_t halfKernelSize = dilationKernelSize / 2;
 	size_t threshold = dilationKernelSize * dilationKernelSize / 2 - 1;
 
-	// Reset previous dilation
-	m_dilatedCapillary.clean();
+	// Fill kernel around each pixel of the rotated capillary with enough pixels in the kernel
+	rotated.rotatedMask.dilate(rotated.dilatedMask, threshold,
+		rotated.limitUp, rotated.limitDn, rotated.limitLf, rotated.limitRt);
+}
+
+void MaxRectangle::findInscribedRectangles(RotatedCapillary& rotated)
+{
+	size_t rowsOfCapillary = rotated.limitDn - rotated.limitUp + 1;
+	size_t colsOfCapillary = rotated.limitRt - rotated.limitLf + 1;
 
-	for (size_t row = m_limitUp; row <= m_limitDn; row++)
+	// Prefix sums of white pixels in the bounding box - shared by all frame sizes
+	size_t prefixCols = colsOfCapillary + 1;
+	std::vector<unsigned int> prefixSums((rowsOfCapillary + 1) * prefixCols, 0);
+	for (size_t row = 0; row < rowsOfCapillary; row++)
 	{
-		for (size_t col = m_limitLf; col <= m_limitRt; col++)
+		word* maskRow = rotated.dilatedMask.getRow(rotated.limitUp + row);
+		unsigned int sumInRow = 0;
+		for (size_t col = 0; col < colsOfCapillary; col++)
 		{
-			// Count pixels in kernel
-			size_t numWhitePixelsInKernel = 0;
-			for (size_t kernelRow = row - halfKernelSize; kernelRow <= row + halfKernelSize; kernelRow++)
-			{
-				for (size_t kernelCol = col - halfKernelSize; kernelCol <= col + halfKernelSize; kernelCol++)
-				{
-					if (m_rotatedCapillary.get(kernelRow, kernelCol) == WHITE)
-					{
-						numWhitePixelsInKernel++;
-					}
-				}
-			}
-
-			// Skip empty areas
-			if (numWhitePixelsInKernel < threshold)
-			{
-				continue;
-			}
-
-			// Fill underfilled areas
-			for (size_t kernelRow = row - halfKernelSize; kernelRow <= row + halfKernelSize; kernelRow++)
-			{
-				for (size_t kernelCol = col - halfKernelSize; kernelCol <= col + halfKernelSize; kernelCol++)
-				{
-					m_dilatedCapillary.set(kernelRow, kernelCol, WHITE);
-				}
-			}
+			size_t maskCol = rotated.limitLf + col;
+			sumInRow += (maskRow[maskCol / BITS_IN_WORD] >> (maskCol % BITS_IN_WORD)) & 1;
+			prefixSums[(row + 1) * prefixCols + col + 1] = prefixSums[row * prefixCols + col + 1] + sumInRow;
 		}
 	}
-}
 
-bool MaxRectangle::findInscribedRectangle()
-{
-	for (size_t row = m_limitUp; row <= m_limitDn - FRAME_HEIGHT; row++)
+	for (size_t sizeIndex = 0; sizeIndex < m_settings.frameSizes.size(); sizeIndex++)
 	{
-		for (size_t col = m_limitLf; col <= m_limitRt - FRAME_WIDTH; col++)
+		const FrameSize& frameSize = m_settings.frameSizes[sizeIndex];
+		FramePlacement& placement = rotated.placements[sizeIndex];
+
+		// Skip frame which is too high or wide for the rotated capillary
+		if ((rowsOfCapillary <= frameSize.height) || (colsOfCapillary <= frameSize.width))
+		{
+			continue;
+		}
+
+		// Number of white pixels in each frame is taken from four prefix sums at its corners
+		for (size_t row = 0; row < rowsOfCapillary - frameSize.height; row++)
 		{
-			size_t numWhitePixelsInRectangle = 0;
-			for (size_t frameRow = row; frameRow < row + FRAME_HEIGHT; frameRow++)
+			const unsigned int* prefixUp = &prefixSums[row * prefixCols];
+			const unsigned int* prefixDn = &prefixSums[(row + frameSize.height) * prefixCols];
+			for (size_t col = 0; col < colsOfCapillary - frameSize.width; col++)
 			{
-				for (size_t frameCol = col; frameCol < col + FRAME_WIDTH; frameCol++)
+				unsigned int numWhitePixelsInRectangle =
+					prefixDn[col + frameSize.width] - prefixDn[col] -
+					prefixUp[col + frameSize.width] + prefixUp[col];
+				float score = (float)numWhitePixelsInRectangle / frameSize.width / frameSize.height;
+				if (score > placement.score)
 				{
-					if (m_dilatedCapillary.get(frameRow, frameCol) == WHITE)
-					{
-						numWhitePixelsInRectangle++;
-					}
+					placement.rowFrame = rotated.limitUp + row;
+					placement.colFrame = rotated.limitLf + col;
+					placement.score = score;
 				}
 			}
-
-			float score = (float)numWhitePixelsInRectangle / FRAME_WIDTH / FRAME_HEIGHT;
-			if (score > m_score)
-			{
-				m_rowFrameInRotated = row;
-				m_colFrameInRotated = col;
-				m_score = score;
-			}
 		}
 	}
-
-	return m_score >= SCORE_THRESHOLD;
 }
 
-void MaxRectangle::markFrameInDilatedCapillary(bool foundInscribedRectangle)
+void MaxRectangle::markFrameInDilatedCapillary(ByteMatrix& dilatedImage, bool foundInscribedRectangle)
 {
 	if (!foundInscribedRectangle)
 	{
 		return;
 	}
 
-	for (size_t row = m_rowFrameInRotated; row <= m_rowFrameInRotated + FRAME_HEIGHT; row++)
+	const FrameSize& frameSize = m_settings.frameSizes[0];
+	const FramePlacement& placement = m_bestRotated.placements[0];
+	for (size_t row = placement.rowFrame; row <= placement.rowFrame + frameSize.height; row++)
 	{
-		m_dilatedCapillary.set(row, m_colFrameInRotated, BLACK);
-		m_dilatedCapillary.set(row, m_colFrameInRotated + FRAME_WIDTH, BLACK);
+		dilatedImage.set(row, placement.colFrame, BLACK);
+		dilatedImage.set(row, placement.colFrame + frameSize.width, BLACK);
 	}
 
-	for (size_t col = m_colFrameInRotated; col <= m_colFrameInRotated + FRAME_WIDTH; col++)
+	for (size_t col = placement.colFrame; col <= placement.colFrame + frameSize.width; col++)
 	{
-		m_dilatedCapillary.set(m_rowFrameInRotated, col, BLACK);
-		m_dilatedCapillary.set(m_rowFrameInRotated + FRAME_HEIGHT, col, BLACK);
+		dilatedImage.set(placement.rowFrame, col, BLACK);
+		dilatedImage.set(placement.rowFrame + frameSize.height, col, BLACK);
 	}
 }
 
@@ -369,15 +346,12 @@ void MaxRectangle::writeWidthMap(const std::string& layerFolderName, size_t capi
 	std::ofstream fileWidthMap(filenameWidthMap);
 	fileWidthMap << "Distance mm,Width mm" << std::endl;
 
-	for (size_t row = m_limitUp; row <= m_limitDn; row++)
+	size_t colsOfCapillary = m_bestRotated.limitRt - m_bestRotated.limitLf + 1;
+	for (size_t row = m_bestRotated.limitUp; row <= m_bestRotated.limitDn; row++)
 	{
-		float distance = pixels2mm(row - m_limitUp);
-		size_t widthPixels = 0;
-		for (size_t col = m_limitLf; col <= m_limitRt; col++)
-		{
-			widthPixels += m_dilatedCapillary.get(row, col) == WHITE ? 1 : 0;
-		}
-		float width = pixels2mm(widthPixels);
+		float distance = pixels2mm(row - m_bestRotated.limitUp, m_settings.pixelsInMm);
+		size_t widthPixels = m_bestRotated.dilatedMask.countInRow(row, m_bestRotated.limitLf, colsOfCapillary);
+		float width = pixels2mm(widthPixels, m_settings.pixelsInMm);
 		fileWidthMap <<
 			std::setw(8) << distance << "," <<
 			std::setw(8) << width << std::endl;
@@ -388,15 +362,18 @@ void MaxRectangle::writeWidthMap(const std::string& layerFolderName, size_t capi
 
 std::vector<PixelPos> MaxRectangle::getRotatedRectangle()
 {
-	size_t centerRow = m_dilatedCapillary.rows() / 2;
-	size_t centerCol = m_dilatedCapillary.cols() / 2;
+	size_t centerRow = m_rotatedSize / 2;
+	size_t centerCol = m_rotatedSize / 2;
+
+	const FrameSize& frameSize = m_settings.frameSizes[0];
+	const FramePlacement& placement = m_bestRotated.placements[0];
 
 	// Set vertices of original unrotated rectangle in predefined order
 	std::vector<PixelPos> originalRectangle;
-	originalRectangle.push_back(PixelPos(m_rowFrameInRotated, m_colFrameInRotated));
-	originalRectangle.push_back(PixelPos(m_rowFrameInRotated, m_colFrameInRotated + FRAME_WIDTH));
-	originalRectangle.push_back(PixelPos(m_rowFrameInRotated + FRAME_HEIGHT, m_colFrameInRotated + FRAME_WIDTH));
-	originalRectangle.push_back(PixelPos(m_rowFrameInRotated + FRAME_HEIGHT, m_colFrameInRotated));
+	originalRectangle.push_back(PixelPos(placement.rowFrame, placement.colFrame));
+	originalRectangle.push_back(PixelPos(placement.rowFrame, placement.colFrame + frameSize.width));
+	originalRectangle.push_back(PixelPos(placement.rowFrame + frameSize.height, placement.colFrame + frameSize.width));
+	originalRectangle.push_back(PixelPos(placement.rowFrame + frameSize.height, placement.colFrame));
 
 	std::vector<PixelPos> rotatedRectangle;
 	for (const PixelPos& pixelPos : originalRectangle)
@@ -4,10 +4,20 @@
 #include <vector>
 
 #include "ByteMatrix.h"
+#include "BitMatrix.h"
+#include "CapillaryRotator.h"
+#include "Trace.h"
 
-const size_t FRAME_WIDTH = 40;
-const size_t FRAME_HEIGHT = 100;
-const float SCORE_THRESHOLD = 0.9F;
+#pragma warning(disable: 26812)
+
+// Angles of frame rotation are searched in half circle due to symmetry of the frame
+const size_t HALF_CIRCLE_DEGREES = 180;
+const size_t COARSE_ANGLE_STEP = 10;
+const size_t FINE_ANGLE_STEP = 1;
+
+// Fine angles are examined on each side of the angle estimated by moments of the capillary
+// only if the frame rotated by the estimated angle does not reach the score threshold
+const size_t MOMENTS_ANGLE_WINDOW = 2;
 
 class PixelPos
 {
@@ -29,38 +39,117 @@ public:
 	}
 };
 
+// Settings of the search - first frame size is the main one: used for the score of the capillary
+class RectangleSettings
+{
+public:
+	AngleSearchType angleSearchType;
+	std::vector<FrameSize> frameSizes;
+	float scoreThreshold;
+	size_t pixelsInMm;
+
+public:
+	RectangleSettings()
+	{
+		angleSearchType = AngleSearchType::SEQUENTIAL;
+		frameSizes.push_back(FrameSize(40, 100));
+		scoreThreshold = 0.9F;
+		pixelsInMm = 1;
+	}
+};
+
+// Best position of the frame of some size in the capillary rotated by some angle
+class FramePlacement
+{
+public:
+	size_t angleDegrees;
+	size_t rowFrame;
+	size_t colFrame;
+	float score;
+
+public:
+	FramePlacement()
+	{
+		angleDegrees = 0;
+		rowFrame = 0;
+		colFrame = 0;
+		score = 0.0F;
+	}
+};
+
+// Capillary rotated by single angle with the best frame of each size found in it
+class RotatedCapillary
+{
+public:
+	size_t angleDegrees;
+	BitMatrix rotatedMask;
+	BitMatrix dilatedMask;
+
+	size_t limitUp;
+	size_t limitDn;
+	size_t limitLf;
+	size_t limitRt;
+
+	// Placements in the order of frame sizes
+	std::vector<FramePlacement> placements;
+
+public:
+	RotatedCapillary()
+	{
+		angleDegrees = 0;
+		limitUp = 0;
+		limitDn = 0;
+		limitLf = 0;
+		limitRt = 0;
+	}
+
+	// Score of the main frame size
+	float getScore()
+	{
+		return placements.empty() ? 0.0F : placements[0].score;
+	}
+};
+
 class MaxRectangle
 {
 public:
 	MaxRectangle(ByteMatrix& byteMatrix, PixelPos start, size_t rows, size_t cols,
-		const std::string& layerFolderName, size_t capillaryIndex);
+		const std::string& layerFolderName, size_t capillaryIndex,
+		const RectangleSettings& settings = RectangleSettings());
 
+	void setPrincipalAxisAngle(float axisAngleRadians);
 	std::vector<PixelPos> findRectangle(const std::string& layerFolderName, size_t capillaryIndex);
 	float getAngle();
 	float getScore();
 
+	// Best placement over all examined angles for each frame size
+	std::vector<FramePlacement> getFramePlacements();
+
 private:
 	ByteMatrix m_originalCapillary;
-	ByteMatrix m_rotatedCapillary;
-	ByteMatrix m_dilatedCapillary;
+	CapillaryRotator m_rotator;
+	size_t m_rotatedSize;
 	PixelPos m_centerInImage;
+	RectangleSettings m_settings;
+	float m_axisAngleRadians;
 
-	size_t m_limitUp;
-	size_t m_limitDn;
-	size_t m_limitLf;
-	size_t m_limitRt;
-
-	size_t m_rowFrameInRotated;
-	size_t m_colFrameInRotated;
+	// Rotation of the capillary with the best score of the main frame among all examined angles
+	RotatedCapillary m_bestRotated;
 	float m_foundAngleRadians;
-	float m_score;
+
+	// Best placement of each frame size among all examined angles
+	std::vector<FramePlacement> m_bestPlacements;
 
 private:
-	void rotateCapillary(size_t angleDegrees);
-	void findCapillaryLimits();
-	void dilateRotatedCapillary();
-	bool findInscribedRectangle();
-	void markFrameInDilatedCapillary(bool foundInscribedRectangle);
+	void searchSequential();
+	void searchCoarseToFine();
+	void searchMoments();
+	void selectBest(RotatedCapillary& rotated, bool isFirst);
+	std::vector<RotatedCapillary> evaluateAngles(const std::vector<size_t>& anglesDegrees);
+	RotatedCapillary evaluateAngle(size_t angleDegrees);
+	void dilateRotatedCapillary(RotatedCapillary& rotated);
+	void findInscribedRectangles(RotatedCapillary& rotated);
+	void markFrameInDilatedCapillary(ByteMatrix& dilatedImage, bool foundInscribedRectangle);
 	void writeWidthMap(const std::string& layerFolderName, size_t capillaryIndex);
 	std::vector<PixelPos> getRotatedRectangle();
 };
@@ -0,0 +1,364 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
+#include <map>
+#include <set>
+#include <numeric>
+#include <sstream>
+#include <functional>
+
+#include "Config.h"
+#include "Map.h"
+#include "LayerScanner.h"
+#include "CapillaryProcessor.h"
+
+// Swept key with all its values
+struct SweepAxis
+{
+	std::string name;
+	std::vector<std::string> values;
+};
+
+// Point of the grid with scores of layers given by description
+struct SweepPoint
+{
+	std::vector<std::string> values;
+	ConfigSnapshot config;
+	size_t detectionIndex = 0;
+	std::vector<float> layerScores;
+	size_t bestLayerIndex = 0;
+	float bestLayerScore = 0.0F;
+};
+
+/*
+	Sweep of detection and description parameters over the grid of values on the already built map.
+	The grid is given as keys with values separated by '|', for example:
+	Identification.GradientThreshold=30|35|40;Characterization.SurroundingPixels=5|10
+	Gradients and excess HPF of layers depend only on the map and not on swept parameters,
+	so they are calculated once and shared by all points of the grid,
+	detection is performed once per unique set of identification parameters.
+*/
+class ParameterSweep
+{
+public:
+	void sweepParameters(Map& map, Config& config, const std::string& grid, JobControl& control)
+	{
+		std::vector<Layer> layers = map.getLayers();
+		if (layers.empty())
+		{
+			throw std::exception("Map must be built before sweep of parameters");
+		}
+
+		std::cout << "Sweep of parameters started" << std::endl << std::endl;
+		m_timer.start();
+
+		parseGrid(grid);
+		createPoints(config);
+
+		const ConfigSnapshot& snapshot = config.getSnapshot();
+		createFoldersIfNeed(snapshot.folders.outputMap, "Sweep");
+		std::string sweepFolderName = snapshot.folders.outputMap + "/Sweep";
+
+		// Gradients do not depend on swept parameters - calculated serially on GPU
+		m_gradients.clear();
+		CornerDetector gradientDetector;
+		control.startStage("Calculation of gradients", layers.size());
+		for (const Layer& layer : layers)
+		{
+			control.checkCancelled();
+			ByteMatrix layerMatrix = layer.matrix;
+			m_gradients.push_back(gradientDetector.calculateGradient(layerMatrix));
+			control.advance();
+		}
+
+		detectCapillaries(map, layers, sweepFolderName, control);
+		filterLayers(map, snapshot, control);
+		describeCapillaries(map, layers, sweepFolderName, control);
+		writeResults(layers.size(), sweepFolderName + "/Sweep.csv");
+
+		m_timer.end();
+		std::cout << "Sweep of parameters completed in " <<
+			m_timer.getDurationMilliseconds() << " ms: " << m_points.size() << " points" << std::endl << std::endl;
+	}
+
+private:
+	std::vector<SweepAxis> m_axes;
+	std::vector<SweepPoint> m_points;
+
+	// Shared intermediates by layer index
+	std::vector<ByteMatrix> m_gradients;
+	std::map<size_t, ByteMatrix> m_filteredLayers;
+
+	// Layers with capillaries for each unique set of identification parameters
+	std::vector<ConfigSnapshot::Identification> m_identifications;
+	std::vector<std::vector<LayerInfo>> m_detections;
+
+	Timer m_timer;
+
+private:
+	void parseGrid(const std::string& grid)
+	{
+		m_axes.clear();
+		std::istringstream gridStream(grid);
+		std::string axisText;
+		while (std::getline(gridStream, axisText, ';'))
+		{
+			size_t delimPos = axisText.find('=');
+			if (delimPos == std::string::npos)
+			{
+				throw std::exception(("Invalid axis of sweep: " + axisText).c_str());
+			}
+
+			SweepAxis axis;
+			axis.name = "HemoScope.Procedures." + axisText.substr(0, delimPos);
+			checkSweptKey(axis.name);
+
+			std::istringstream valuesStream(axisText.substr(delimPos + 1));
+			std::string value;
+			while (std::getline(valuesStream, value, '|'))
+			{
+				axis.values.push_back(value);
+			}
+			if (axis.values.empty())
+			{
+				throw std::exception(("No values are given to sweep: " + axis.name).c_str());
+			}
+			m_axes.push_back(axis);
+		}
+
+		if (m_axes.empty())
+		{
+			throw std::exception("No parameters are given to sweep");
+		}
+	}
+
+	// Only parameters of detection and description can be swept on the built map
+	static void checkSweptKey(const std::string& key)
+	{
+		const std::vector<std::string> sweptKeys =
+		{
+			keyCroppedRows, keyGrayLevelOriginalMin, keyGrayLevelOriginalMax, keyGradientThreshold,
+			keyMinDistancePixels, keyMinFoundCapillaries, keyGrayLevelProcessedMin, keyGrayLevelProcessedMax,
+			keyNumDescribedCappilaries, keyMinPixelsInCappilary, keySurroundingPixels, keyAngleSearch,
+			keyFrameSizes, keyFrameScoreThreshold
+		};
+		if (std::find(sweptKeys.begin(), sweptKeys.end(), key) != sweptKeys.end())
+		{
+			return;
+		}
+
+		// Kernel of deep smoothing defines seams of the stitched map
+		if ((key == keyDeepSmoothingKernelSize) || key.starts_with("HemoScope.Procedures.Stitching."))
+		{
+			throw std::exception(("Sweep of the key requires rebuilding the map: " + key).c_str());
+		}
+		throw std::exception(("Key cannot be swept: " + key).c_str());
+	}
+
+	// Points are the Cartesian product of the axes, the last axis changes fastest
+	void createPoints(Config& config)
+	{
+		m_points.clear();
+		size_t pointsNum = std::accumulate(m_axes.begin(), m_axes.end(), (size_t)1,
+			[](size_t product, const SweepAxis& axis) { return product * axis.values.size(); });
+
+		for (size_t pointIndex = 0; pointIndex < pointsNum; pointIndex++)
+		{
+			SweepPoint point;
+			Config pointConfig = config;
+			size_t remainder = pointIndex;
+			point.values.resize(m_axes.size());
+			for (size_t axisIndex = m_axes.size(); axisIndex-- > 0;)
+			{
+				const SweepAxis& axis = m_axes[axisIndex];
+				point.values[axisIndex] = axis.values[remainder % axis.values.size()];
+				remainder /= axis.values.size();
+				pointConfig.setOverride(axis.name, point.values[axisIndex]);
+			}
+			point.config = pointConfig.getSnapshot();
+			m_points.push_back(point);
+		}
+	}
+
+	static bool isSameIdentification(const ConfigSnapshot::Identification& identificationL,
+		const ConfigSnapshot::Identification& identificationR)
+	{
+		return
+			(identificationL.croppedRows == identificationR.croppedRows) &&
+			(identificationL.grayLevelOriginalMin == identificationR.grayLevelOriginalMin) &&
+			(identificationL.grayLevelOriginalMax == identificationR.grayLevelOriginalMax) &&
+			(identificationL.gradientThreshold == identificationR.gradientThreshold) &&
+			(identificationL.minDistancePixels == identificationR.minDistancePixels) &&
+			(identificationL.minFoundCapillaries == identificationR.minFoundCapillaries);
+	}
+
+	void detectCapillaries(Map& map, const std::vector<Layer>& layers, const std::string& sweepFolderName,
+		JobControl& control)
+	{
+		// Points sharing identification parameters share detected corners
+		m_identifications.clear();
+		std::vector<ConfigSnapshot> detectionConfigs;
+		for (SweepPoint& point : m_points)
+		{
+			size_t detectionIndex = 0;
+			while ((detectionIndex < m_identifications.size()) &&
+				!isSameIdentification(m_identifications[detectionIndex], point.config.identification))
+			{
+				detectionIndex++;
+			}
+			if (detectionIndex == m_identifications.size())
+			{
+				m_identifications.push_back(point.config.identification);
+				detectionConfigs.push_back(point.config);
+			}
+			point.detectionIndex = detectionIndex;
+		}
+
+		std::cout << "Sweep - detection of capillaries: " << detectionConfigs.size() << " sets of parameters" <<
+			std::endl << std::endl;
+
+		m_detections.assign(detectionConfigs.size(), std::vector<LayerInfo>());
+		control.startStage("Detection of capillaries", detectionConfigs.size() * layers.size());
+		runTasks(detectionConfigs.size(), [&](size_t detectionIndex)
+			{
+				std::string detectionFolderName = sweepFolderName + "/Detection" + std::to_string(detectionIndex + 1);
+#ifdef _DEBUG
+				createFoldersIfNeed(sweepFolderName, "Detection" + std::to_string(detectionIndex + 1));
+#endif
+				// Detection and acceptance of layers are the same as in the pipeline
+				LayerScanner layerScanner;
+				layerScanner.init(detectionConfigs[detectionIndex]);
+				for (size_t layerIndex = 0; layerIndex < layers.size(); layerIndex++)
+				{
+					control.checkCancelled();
+					Layer layer = layers[layerIndex];
+					LayerInfo layerInfo = layerScanner.detectLayer(map, layer, layerIndex, m_gradients[layerIndex],
+						detectionFolderName);
+					if (layerScanner.hasEnoughCapillaries(layerInfo))
+					{
+						m_detections[detectionIndex].push_back(layerInfo);
+					}
+					control.advance();
+				}
+			});
+	}
+
+	// Excess HPF depends only on the kernel of deep smoothing which is not swept - calculated serially on GPU
+	void filterLayers(Map& map, const ConfigSnapshot& config, JobControl& control)
+	{
+		std::set<size_t> detectedLayers;
+		for (const std::vector<LayerInfo>& detection : m_detections)
+		{
+			for (const LayerInfo& layerInfo : detection)
+			{
+				detectedLayers.insert(layerInfo.layerIndex);
+			}
+		}
+
+		m_filteredLayers.clear();
+		CapillaryProcessor capillaryProcessor;
+		capillaryProcessor.init(config);
+		control.startStage("Filtering of layers", detectedLayers.size());
+		for (size_t layerIndex : detectedLayers)
+		{
+			control.checkCancelled();
+			m_filteredLayers[layerIndex] = capillaryProcessor.filterLayer(map, layerIndex);
+			control.advance();
+		}
+	}
+
+	void describeCapillaries(Map& map, const std::vector<Layer>& layers, const std::string& sweepFolderName,
+		JobControl& control)
+	{
+		control.startStage("Description of capillaries", m_points.size());
+		runTasks(m_points.size(), [&](size_t pointIndex)
+			{
+				SweepPoint& point = m_points[pointIndex];
+				point.layerScores.assign(layers.size(), 0.0F);
+				std::string pointFolderName = "Point" + std::to_string(pointIndex + 1);
+				createFoldersIfNeed(sweepFolderName, pointFolderName);
+
+				CapillaryProcessor capillaryProcessor;
+				capillaryProcessor.init(point.config);
+				for (LayerInfo layerInfo : m_detections[point.detectionIndex])
+				{
+					// Pixels of capillaries are marked in the processed matrix, so each point needs own copy
+					ByteMatrix processedMatrix = m_filteredLayers.at(layerInfo.layerIndex).clone();
+#ifdef _DEBUG
+					// Frames are drawn on the original matrix
+					ByteMatrix originalMatrix = layers[layerInfo.layerIndex].matrix.clone();
+#else
+					ByteMatrix originalMatrix = layers[layerInfo.layerIndex].matrix;
+#endif
+					capillaryProcessor.describeCapillaries(map, layerInfo, originalMatrix, processedMatrix,
+						sweepFolderName + "/" + pointFolderName, control);
+
+					point.layerScores[layerInfo.layerIndex] = layerInfo.sumScore;
+					if (layerInfo.sumScore > point.bestLayerScore)
+					{
+						point.bestLayerIndex = layerInfo.layerIndex;
+						point.bestLayerScore = layerInfo.sumScore;
+					}
+				}
+				control.advance();
+			});
+	}
+
+	void writeResults(size_t layersNum, const std::string& filenameResults)
+	{
+		std::ofstream fileResults(filenameResults);
+		fileResults << "Point";
+		for (const SweepAxis& axis : m_axes)
+		{
+			fileResults << "," << axis.name.substr(std::string("HemoScope.Procedures.").size());
+		}
+		for (size_t layerIndex = 0; layerIndex < layersNum; layerIndex++)
+		{
+			fileResults << ",Layer " << layerIndex + 1;
+		}
+		fileResults << ",Best layer,Best score" << std::endl;
+
+		for (size_t pointIndex = 0; pointIndex < m_points.size(); pointIndex++)
+		{
+			const SweepPoint& point = m_points[pointIndex];
+			fileResults << pointIndex + 1;
+			for (const std::string& value : point.values)
+			{
+				// Values with commas are quoted, for example list of frame sizes
+				fileResults << "," << (value.find(',') == std::string::npos ? value : "\"" + value + "\"");
+			}
+			for (float layerScore : point.layerScores)
+			{
+				fileResults << "," << toString(layerScore, 1);
+			}
+			fileResults << "," << point.bestLayerIndex + 1 << "," << toString(point.bestLayerScore, 1) << std::endl;
+		}
+		fileResults.close();
+	}
+
+	// Each task takes the next job until all jobs are done
+	static void runTasks(size_t jobsNum, const std::function<void(size_t)>& job)
+	{
+		size_t tasksNum = std::min((size_t)std::max(std::thread::hardware_concurrency(), 1U), jobsNum);
+		std::atomic<size_t> nextJobIndex = 0;
+		std::vector<std::future<void>> futures;
+		for (size_t taskIndex = 0; taskIndex < tasksNum; taskIndex++)
+		{
+			futures.push_back(std::async(std::launch::async, [&]()
+				{
+					for (size_t jobIndex = nextJobIndex++; jobIndex < jobsNum; jobIndex = nextJobIndex++)
+					{
+						job(jobIndex);
+					}
+				}));
+		}
+		for (std::future<void>& future : futures)
+		{
+			future.get();
+		}
+	}
+};
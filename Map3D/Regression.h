@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+
+struct RegressionResult
+{
+	float slope;
+	float offset;
+};
+
+// Regression of y on x accumulated sample by sample: means and co-moments are updated by Welford's method
+// in double precision, so samples can be added and removed in any order and the fit is queried in O(1)
+class RegressionAccumulator
+{
+public:
+	RegressionAccumulator()
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		m_n = 0;
+		m_meanX = 0.0;
+		m_meanY = 0.0;
+		m_momentXX = 0.0;
+		m_momentXY = 0.0;
+	}
+
+	void add(float x, float y)
+	{
+		m_n++;
+		double dx = (double)x - m_meanX;
+		m_meanX += dx / m_n;
+		m_meanY += ((double)y - m_meanY) / m_n;
+		m_momentXX += dx * ((double)x - m_meanX);
+		m_momentXY += dx * ((double)y - m_meanY);
+	}
+
+	// Removes sample added before: reverse of add with means of the remaining samples
+	void remove(float x, float y)
+	{
+		if (m_n <= 1)
+		{
+			reset();
+			return;
+		}
+		m_n--;
+		double dx = (double)x - m_meanX;
+		double dy = (double)y - m_meanY;
+		m_meanX -= dx / m_n;
+		m_meanY -= dy / m_n;
+		double dxRemaining = (double)x - m_meanX;
+		m_momentXX -= dxRemaining * dx;
+		m_momentXY -= dxRemaining * dy;
+	}
+
+	size_t size() const
+	{
+		return m_n;
+	}
+
+	// Zero line if markers do not vary
+	RegressionResult fit() const
+	{
+		RegressionResult result{};
+		if ((m_n < 2) || (m_momentXX <= 0.0))
+		{
+			return result;
+		}
+		double slope = m_momentXY / m_momentXX;
+		result.slope = (float)slope;
+		result.offset = (float)(m_meanY - slope * m_meanX);
+		return result;
+	}
+
+private:
+	size_t m_n;
+	double m_meanX;
+	double m_meanY;
+
+	// Sums of (x - meanX)^2 and (x - meanX) * (y - meanY)
+	double m_momentXX;
+	double m_momentXY;
+};
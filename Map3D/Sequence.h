@@ -2,8 +2,12 @@
 
 #include <string>
 #include <vector>
+#include <list>
+#include <mutex>
 #include <fstream>
+#include <iterator>
 #include <filesystem>
+#include <unordered_map>
 
 #pragma warning(push)
 #pragma warning(disable: 5054)
@@ -11,36 +15,100 @@
 #include <opencv2/imgcodecs.hpp>
 #pragma warning(pop)
 
-#include "ByteMatrix.h"
+#include "BitMatrix.h"
 
 class Projection
 {
 public:
 	ByteMatrix wideMatrix;
-	ByteMatrix lineMatrix;
+	BitMatrix lineMatrix;
 	float z;
-	Projection(const ByteMatrix& wideMat, const ByteMatrix& lineMat, float posZ)
+	Projection(const ByteMatrix& wideMat, const BitMatrix& lineMat, float posZ)
 	{
 		wideMatrix = wideMat;
 		lineMatrix = lineMat;
 		z = posZ;
 	}
+
+	size_t sizeBytes()
+	{
+		return wideMatrix.rows() * wideMatrix.cols() + lineMatrix.rows() * lineMatrix.wordsInRow() * sizeof(word);
+	}
+};
+
+// Files of projection indexed by the sequence - decoded only on access
+class ProjectionFiles
+{
+public:
+	std::string wideFilename;
+	std::string lineFilename;
+	float z;
+	ProjectionFiles(const std::string& wideFile, const std::string& lineFile, float posZ)
+	{
+		wideFilename = wideFile;
+		lineFilename = lineFile;
+		z = posZ;
+	}
 };
 
 class Sequence
 {
+public:
+	// Iterates projections in order of Z positions, each projection is decoded or taken from cache
+	class Iterator
+	{
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = Projection;
+		using difference_type = std::ptrdiff_t;
+		using pointer = Projection*;
+		using reference = Projection;
+
+		Iterator(Sequence* sequence, size_t index)
+		{
+			m_sequence = sequence;
+			m_index = index;
+		}
+
+		Projection operator*() const
+		{
+			return m_sequence->getProjection(m_index);
+		}
+
+		Iterator& operator++()
+		{
+			m_index++;
+			return *this;
+		}
+
+		bool operator==(const Iterator& other) const
+		{
+			return (m_sequence == other.m_sequence) && (m_index == other.m_index);
+		}
+
+		bool operator!=(const Iterator& other) const
+		{
+			return !(*this == other);
+		}
+
+	private:
+		Sequence* m_sequence;
+		size_t m_index;
+	};
+
 public:
 	Sequence()
 	{
+		m_cacheBudgetBytes = 0;
+		m_cachedBytes = 0;
 	}
 
-	std::vector<float> loadPositionsZ(const std::string& folderName, Config& config)
+	std::vector<float> loadPositionsZ(const std::string& folderName, const ConfigSnapshot& config)
 	{
 		std::vector<float> positionsZ;
 
 		// Open file with Z positions
-		std::string zPosFilename = config.getStringValue(keyZPosFilename);
-		std::string zPosPathFilename = folderName + "/" + zPosFilename;
+		std::string zPosPathFilename = folderName + "/" + config.focusing.zPosFilename;
 		std::ifstream zPosFile(zPosPathFilename);
 
 		// Iterate Z positions in the file and fill the vector of projections
@@ -59,7 +127,7 @@ public:
 		return positionsZ;
 	}
 
-	void buildSequence(const std::string& folderName, Config& config)
+	void buildSequence(const std::string& folderName, const ConfigSnapshot& config)
 	{
 		std::filesystem::path folder = std::filesystem::absolute(std::filesystem::path(folderName));
 		std::string absFolderName = folder.generic_string();
@@ -71,12 +139,16 @@ public:
 		char lineFilename[fileNameSize];
 		size_t fileIndex = 0;
 
+		// Memory budget of decoded projections
+		m_cacheBudgetBytes = config.focusing.sequenceCacheMegabytes * 1024 * 1024;
+		clearCache();
+		m_projectionFiles.clear();
+
 		// Open file with Z positions
-		std::string zPosFilename = config.getStringValue(keyZPosFilename);
-		std::string zPosPathFilename = folderName + "/" + zPosFilename;
+		std::string zPosPathFilename = folderName + "/" + config.focusing.zPosFilename;
 		std::ifstream zPosFile(zPosPathFilename);
 
-		// Iterate Z positions in the file and fill the vector of projections
+		// Iterate Z positions in the file and index files of projections - images are not decoded here
 		std::string line;
 		while (!zPosFile.eof())
 		{
@@ -88,16 +160,9 @@ public:
 			float z = (float)atof(line.c_str());
 
 			sprintf_s(wideFilename, fileNameSize, "Bright%4d.tif", (int)fileIndex);
-			cv::Mat wideImage = cv::imread(folderName + "/" + wideFilename, cv::IMREAD_GRAYSCALE);
-			ByteMatrix wideMatrix(wideImage.rows, wideImage.cols);
-			image2Matrix(wideImage, wideMatrix, false);
-
 			sprintf_s(lineFilename, fileNameSize, "Line%4d.tif", (int)fileIndex);
-			cv::Mat lineImage = cv::imread(folderName + "/" + lineFilename, cv::IMREAD_GRAYSCALE);
-			ByteMatrix lineMatrix(lineImage.rows, lineImage.cols);
-			image2Matrix(lineImage, lineMatrix, true);
-
-			m_projections.push_back(Projection(wideMatrix, lineMatrix, z));
+			m_projectionFiles.push_back(ProjectionFiles(
+				folderName + "/" + wideFilename, folderName + "/" + lineFilename, z));
 
 			fileIndex++;
 		}
@@ -111,7 +176,7 @@ public:
 
 		size_t fileIndex = 0;
 		bool result = true;
-		for (Projection& projection : m_projections)
+		for (Projection projection : *this)
 		{
 			std::string wideFilename = outputFolderName + "/Projections/Wide" +
 				std::to_string(fileIndex) + ".bmp";
@@ -123,7 +188,7 @@ public:
 
 			std::string lineFilename = outputFolderName + "/Projections/Line" +
 				std::to_string(fileIndex) + ".bmp";
-			result = cv::imwrite(lineFilename, projection.lineMatrix.asCvMatU8());
+			result = cv::imwrite(lineFilename, projection.lineMatrix.asByteMatrix(WHITE, BLACK).asCvMatU8());
 			if (!result)
 			{
 				throw std::exception(("Cannot write file: " + lineFilename).c_str());
@@ -133,28 +198,100 @@ public:
 		}
 	}
 
-	std::vector<Projection> getProjections()
+	size_t size()
 	{
-		return m_projections;
+		return m_projectionFiles.size();
 	}
 
-private:
-	std::vector<Projection> m_projections;
+	Iterator begin()
+	{
+		return Iterator(this, 0);
+	}
 
-private:
-	void image2Matrix(const cv::Mat& srcImage, ByteMatrix& dstMatrix, bool makeContrast)
+	Iterator end()
+	{
+		return Iterator(this, m_projectionFiles.size());
+	}
+
+	// Projection is decoded on first access and kept in cache until evicted as least recently used
+	Projection getProjection(size_t index)
 	{
-		for (size_t row = 0; row < srcImage.rows; row++)
 		{
-			for (size_t col = 0; col < srcImage.cols; col++)
+			std::lock_guard<std::mutex> lock(m_cacheMutex);
+			std::unordered_map<size_t, CacheEntry>::iterator cached = m_cache.find(index);
+			if (cached != m_cache.end())
 			{
-				byte val = srcImage.at<byte>((int)row, (int)col);
-				if (makeContrast)
-				{
-					val = val <= DELIM ? BLACK : WHITE;
-				}
-				dstMatrix.set(row, col, val);
+				m_recentlyUsed.splice(m_recentlyUsed.begin(), m_recentlyUsed, cached->second.usage);
+				return cached->second.projection;
 			}
 		}
+
+		// Decode out of lock to allow concurrent decoding of different projections
+		Projection projection = decodeProjection(m_projectionFiles[index]);
+
+		std::lock_guard<std::mutex> lock(m_cacheMutex);
+		if (m_cache.contains(index))
+		{
+			return projection;
+		}
+		m_recentlyUsed.push_front(index);
+		m_cache.emplace(index, CacheEntry(projection, m_recentlyUsed.begin()));
+		m_cachedBytes += projection.sizeBytes();
+
+		// Evict least recently used projections over the budget - the last decoded is always kept
+		while ((m_cachedBytes > m_cacheBudgetBytes) && (m_recentlyUsed.size() > 1))
+		{
+			size_t evictedIndex = m_recentlyUsed.back();
+			m_recentlyUsed.pop_back();
+			m_cachedBytes -= m_cache.at(evictedIndex).projection.sizeBytes();
+			m_cache.erase(evictedIndex);
+		}
+
+		return projection;
+	}
+
+private:
+	class CacheEntry
+	{
+	public:
+		Projection projection;
+		std::list<size_t>::iterator usage;
+		CacheEntry(const Projection& cachedProjection, std::list<size_t>::iterator usageIterator) :
+			projection(cachedProjection)
+		{
+			usage = usageIterator;
+		}
+	};
+
+	std::vector<ProjectionFiles> m_projectionFiles;
+
+	// Cache of decoded projections with order of usage: most recently used at front
+	std::unordered_map<size_t, CacheEntry> m_cache;
+	std::list<size_t> m_recentlyUsed;
+	size_t m_cacheBudgetBytes;
+	size_t m_cachedBytes;
+	std::mutex m_cacheMutex;
+
+private:
+	void clearCache()
+	{
+		std::lock_guard<std::mutex> lock(m_cacheMutex);
+		m_cache.clear();
+		m_recentlyUsed.clear();
+		m_cachedBytes = 0;
+	}
+
+	Projection decodeProjection(const ProjectionFiles& projectionFiles)
+	{
+		// Decoded images are adopted by matrices without copy
+		cv::Mat wideImage = cv::imread(projectionFiles.wideFilename, cv::IMREAD_GRAYSCALE);
+		ByteMatrix wideMatrix(wideImage);
+
+		// Line image is contrast, so it is packed to one bit per pixel
+		cv::Mat lineImage = cv::imread(projectionFiles.lineFilename, cv::IMREAD_GRAYSCALE);
+		ByteMatrix lineBytes(lineImage);
+		BitMatrix lineMatrix(lineBytes, DELIM);
+
+		return Projection(wideMatrix, lineMatrix, projectionFiles.z);
 	}
 };
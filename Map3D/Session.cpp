@@ -0,0 +1,352 @@
+#include "Session.h"
+
+Session::Session()
+{
+	m_bestLayerIndex = -1;
+	m_isJobRunning = false;
+}
+
+Job* Session::startJob(const std::function<void(JobControl&)>& stage, ProgressCallback callback, void* userData)
+{
+	if (m_isJobRunning.exchange(true))
+	{
+		throw std::exception("Another job of the session is running");
+	}
+	Job* job = new Job(callback, userData);
+	job->start(stage, [this]() { m_isJobRunning = false; });
+	return job;
+}
+
+void Session::runStage(const std::function<void(JobControl&)>& stage)
+{
+	if (m_isJobRunning.exchange(true))
+	{
+		throw std::exception("Another job of the session is running");
+	}
+	JobControl control;
+	try
+	{
+		stage(control);
+	}
+	catch (...)
+	{
+		m_isJobRunning = false;
+		throw;
+	}
+	m_isJobRunning = false;
+}
+
+// Configuration and results of the stages are used by the running job without locks
+void Session::checkNoJobRunning()
+{
+	if (m_isJobRunning)
+	{
+		throw std::exception("Another job of the session is running");
+	}
+}
+
+void Session::loadConfig(const std::string& configFilename)
+{
+	checkNoJobRunning();
+	bool loadResult = m_config.load(configFilename);
+	if (!loadResult)
+	{
+		std::cout << "Cannot load config file: " << configFilename << std::endl << std::endl;
+	}
+}
+
+// General data is taken from the configuration by each stage - only the configuration is compiled here
+void Session::initGeneralData()
+{
+	checkNoJobRunning();
+	m_config.getSnapshot();
+}
+
+void Session::setOverride(const std::string& key, int val)
+{
+	checkNoJobRunning();
+	m_config.setOverride(key, val);
+}
+
+void Session::setOverride(const std::string& key, float val)
+{
+	checkNoJobRunning();
+	m_config.setOverride(key, val);
+}
+
+void Session::setOverride(const std::string& key, const std::string& val)
+{
+	checkNoJobRunning();
+	m_config.setOverride(key, val);
+}
+
+void Session::buildMap(JobControl& control)
+{
+	TRACE_SCOPE("Stage: build map");
+	const ConfigSnapshot& snapshot = m_config.getSnapshot();
+	m_map.buildMap(snapshot.folders.inputMap, snapshot, control);
+}
+
+void Session::beginTileScan(float startX, float startY, float stepX, float stepY, int countX, int countY,
+	int tileRows, int tileCols)
+{
+	checkNoJobRunning();
+	if ((countX <= 0) || (countY <= 0) || (tileRows <= 0) || (tileCols <= 0))
+	{
+		throw std::exception("Scan grid and tiles must not be empty");
+	}
+	m_layersWithCapillaries.clear();
+	m_bestLayerIndex = -1;
+	m_map.beginTileScan(m_config.getSnapshot(), startX, startY, stepX, stepY,
+		(size_t)countX, (size_t)countY, (size_t)tileRows, (size_t)tileCols);
+}
+
+void Session::addTile(const unsigned char* pixels, int rows, int cols, int stride, float x, float y, float z)
+{
+	checkNoJobRunning();
+	if ((rows <= 0) || (cols <= 0) || (stride <= 0))
+	{
+		throw std::exception("Tile does not match the started scan");
+	}
+	m_map.addTile(pixels, (size_t)rows, (size_t)cols, (size_t)stride, x, y, z);
+}
+
+void Session::finalizeTileScan()
+{
+	checkNoJobRunning();
+	m_map.finalizeTileScan();
+}
+
+void Session::printValueAtTruncatedPos(float x, float y, float z)
+{
+	checkNoJobRunning();
+	m_map.printValueAtTruncatedPos(x, y, z);
+}
+
+void Session::saveStiched()
+{
+	checkNoJobRunning();
+	m_map.saveStiched(m_layersWithCapillaries, m_config.getSnapshot().folders.outputMap);
+}
+
+void Session::detectCapillaries(JobControl& control)
+{
+	TRACE_SCOPE("Stage: detect capillaries");
+	const ConfigSnapshot& snapshot = m_config.getSnapshot();
+	m_bestLayerIndex = -1;
+	m_layersWithCapillaries = m_layerScanner.detectCapillaries(m_map, snapshot.folders.outputMap, snapshot,
+		control);
+}
+
+void Session::describeCapillaries(JobControl& control)
+{
+	TRACE_SCOPE("Stage: describe capillaries");
+	const ConfigSnapshot& snapshot = m_config.getSnapshot();
+	std::string outputFolderNameMap = snapshot.folders.outputMap;
+	m_bestLayerIndex = -1;
+	m_capillaryProcessor.init(snapshot);
+	control.startStage("Description of capillaries", m_layersWithCapillaries.size());
+	for (LayerInfo& layerInfo : m_layersWithCapillaries)
+	{
+		m_capillaryProcessor.describeCapillaries(m_map, layerInfo, outputFolderNameMap, control);
+		control.advance();
+	}
+	selectBestLayer(outputFolderNameMap);
+}
+
+// Map is built, detected and described in one stage with overlapped processing of layers
+void Session::processMap(JobControl& control)
+{
+	TRACE_SCOPE("Stage: process map");
+	const ConfigSnapshot& snapshot = m_config.getSnapshot();
+	m_bestLayerIndex = -1;
+	m_layersWithCapillaries.clear();
+	m_layersWithCapillaries = m_layerPipeline.processLayers(m_map, m_layerScanner, m_capillaryProcessor,
+		snapshot, control);
+	selectBestLayer(snapshot.folders.outputMap);
+}
+
+void Session::selectBestLayer(const std::string& outputFolderNameMap)
+{
+	if (m_layersWithCapillaries.empty())
+	{
+		std::cout << "No layers with enough capillaries are found" << std::endl << std::endl;
+		return;
+	}
+#ifdef _DEBUG
+	// Create and init file containing data of all layers
+	std::string filenameAllLayers = outputFolderNameMap + "/Capillaries/ActualLayersFrames.csv";
+	std::ofstream fileAllLayers(filenameAllLayers);
+	fileAllLayers << "Layer,Frames,Max score,Sum score" << std::endl;
+#endif
+	size_t bestLayerIndex = 0;
+	float bestLayerSumScore = 0.0F;
+	for (const LayerInfo& layerInfo : m_layersWithCapillaries)
+	{
+#ifdef _DEBUG
+		std::string printedLine =
+			std::to_string(layerInfo.layerIndex + 1) + "," +
+			std::to_string(layerInfo.capillariesInfo.size()) + "," +
+			toString(layerInfo.maxScore, 1) + "," +
+			toString(layerInfo.sumScore, 1);
+		fileAllLayers << printedLine << std::endl;
+#endif
+		if (layerInfo.sumScore > bestLayerSumScore)
+		{
+			bestLayerIndex = layerInfo.layerIndex;
+			bestLayerSumScore = layerInfo.sumScore;
+		}
+	}
+	m_bestLayerIndex = (int)bestLayerIndex;
+	std::cout << "Best layer: " << m_bestLayerIndex + 1 << std::endl << std::endl;
+	std::string filenameSummary = outputFolderNameMap + "/Summary.txt";
+	std::ofstream fileSummary(filenameSummary);
+	fileSummary << "Best layer: " << m_bestLayerIndex + 1 << std::endl;
+	fileSummary.close();
+#ifdef _DEBUG
+	fileAllLayers.close();
+#endif
+}
+
+void Session::sweepParameters(const std::string& grid, JobControl& control)
+{
+	TRACE_SCOPE("Stage: sweep parameters");
+	m_parameterSweep.sweepParameters(m_map, m_config, grid, control);
+}
+
+size_t Session::getLayersNum()
+{
+	return m_map.getLayers().size();
+}
+
+// Index of the best layer found by the last description, or -1 if no layer was described
+int Session::getBestLayerIndex()
+{
+	return m_bestLayerIndex;
+}
+
+void Session::loadPositionsZ()
+{
+	checkNoJobRunning();
+	const ConfigSnapshot& snapshot = m_config.getSnapshot();
+	m_positionsZ = m_sequence.loadPositionsZ(snapshot.folders.inputLock, snapshot);
+}
+
+void Session::buildSequence()
+{
+	checkNoJobRunning();
+	TRACE_SCOPE("Stage: build sequence");
+	const ConfigSnapshot& snapshot = m_config.getSnapshot();
+	m_sequence.buildSequence(snapshot.folders.inputLock, snapshot);
+}
+
+void Session::saveProjections()
+{
+	checkNoJobRunning();
+	TRACE_SCOPE("Stage: save projections");
+	m_sequence.saveProjections(m_config.getSnapshot().folders.outputLock);
+}
+
+void Session::calculateDepth(JobControl& control)
+{
+	TRACE_SCOPE("Stage: calculate depth");
+	const ConfigSnapshot& snapshot = m_config.getSnapshot();
+	const std::string& inputFolderNameLock = snapshot.folders.inputLock;
+	const std::string& outputFolderNameLock = snapshot.folders.outputLock;
+
+	// All selected metrics are compared reading each image once
+	if (snapshot.focusing.isCompareMethod)
+	{
+		const std::vector<FocusMetricType>& metricTypes = snapshot.focusing.compareMetrics;
+		m_focusEvaluator.init(snapshot);
+		std::vector<std::vector<float>> markers = m_focusEvaluator.calculateMetrics(inputFolderNameLock,
+			outputFolderNameLock, m_positionsZ, metricTypes, control);
+		for (size_t metricIndex = 0; metricIndex < metricTypes.size(); metricIndex++)
+		{
+			m_markerCache.store(MarkerCache::makeKey(inputFolderNameLock, metricTypes[metricIndex], snapshot),
+				markers[metricIndex]);
+		}
+		return;
+	}
+
+	// Markers of each calculated metric are cached for calibration
+	FocusMetricType metricType = snapshot.focusing.metricType;
+	std::vector<float> markers;
+	switch (metricType)
+	{
+	case FocusMetricType::METRIC_MODE:
+		markers = m_wideImageProcessor.calculateStatistics(inputFolderNameLock, outputFolderNameLock,
+			m_positionsZ, ImageMarkerType::GRAY_LEVEL_MODE, snapshot, control);
+		break;
+	case FocusMetricType::METRIC_VARIANCE:
+		markers = m_wideImageProcessor.calculateStatistics(inputFolderNameLock, outputFolderNameLock,
+			m_positionsZ, ImageMarkerType::GRAY_LEVEL_VARIANCE, snapshot, control);
+		break;
+	case FocusMetricType::METRIC_SPECTRUM:
+		m_spectrumAnalyzer.init(snapshot);
+		markers = m_spectrumAnalyzer.calculateSpectrum(inputFolderNameLock, outputFolderNameLock, m_positionsZ,
+			control);
+		break;
+	default:
+		m_focusEvaluator.init(snapshot);
+		markers = m_focusEvaluator.calculateMetrics(inputFolderNameLock, outputFolderNameLock,
+			m_positionsZ, { metricType }, control)[0];
+		break;
+	}
+	m_markerCache.store(MarkerCache::makeKey(inputFolderNameLock, metricType, snapshot), markers);
+}
+
+void Session::validateCalibration(JobControl& control)
+{
+	TRACE_SCOPE("Stage: validate calibration");
+	const ConfigSnapshot& snapshot = m_config.getSnapshot();
+	if (snapshot.focusing.isCompareMethod)
+	{
+		throw std::exception("Calibration cannot be validated for method: Compare");
+	}
+	const std::string& inputFolderNameLock = snapshot.folders.inputLock;
+	FocusMetricType metricType = snapshot.focusing.metricType;
+
+	// Images are processed only if markers of the metric are not cached yet
+	std::string markersKey = MarkerCache::makeKey(inputFolderNameLock, metricType, snapshot);
+	std::vector<float> markers;
+	if (!m_markerCache.find(markersKey, m_positionsZ.size(), markers))
+	{
+		m_focusEvaluator.init(snapshot);
+		markers = m_focusEvaluator.calculateMarkers(inputFolderNameLock, m_positionsZ.size(), { metricType },
+			control)[0];
+		m_markerCache.store(markersKey, markers);
+	}
+
+	m_calibrationEngine.init(snapshot);
+	ValidationResult result = m_calibrationEngine.validate(markers, m_positionsZ);
+	m_calibrationEngine.saveValidation(result, snapshot.folders.outputLock);
+	std::cout << "Calibration RMS error: " << result.rmsError << std::endl << std::endl;
+}
+
+void Session::initFocusLock()
+{
+	checkNoJobRunning();
+	m_focusLock.init(m_config.getSnapshot());
+}
+
+void Session::loadFocusLockCalibration(const std::string& calibrationFilename)
+{
+	m_focusLock.loadCalibration(calibrationFilename);
+}
+
+void Session::setFocusLockCalibration(float slope, float offset)
+{
+	m_focusLock.setCalibration(RegressionResult{ slope, offset });
+}
+
+float Session::processFocusLockFrame(const unsigned char* pixels, int rows, int cols, int stride)
+{
+	TRACE_SCOPE("Focus lock frame");
+	return m_focusLock.processFrame(pixels, (size_t)rows, (size_t)cols, (size_t)stride);
+}
+
+LatencyPercentiles Session::getFocusLockLatency()
+{
+	return m_focusLock.getLatencyPercentiles();
+}
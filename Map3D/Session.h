@@ -0,0 +1,87 @@
+#pragma once
+
+#include "LayerScanner.h"
+#include "CapillaryProcessor.h"
+#include "Sequence.h"
+#include "LineImageProcessor.h"
+#include "WideImageProcessor.h"
+#include "SpectrumAnalyzer.h"
+#include "FocusMetrics.h"
+#include "FocusLock.h"
+#include "CalibrationEngine.h"
+#include "ParameterSweep.h"
+#include "LayerPipeline.h"
+#include "Job.h"
+
+// All state of processing of one dataset: configuration, map, sequence and results of the stages.
+// Sessions do not share any data, so different sessions can be processed concurrently.
+class Session
+{
+public:
+	Session();
+
+	void loadConfig(const std::string& configFilename);
+	void initGeneralData();
+	void setOverride(const std::string& key, int val);
+	void setOverride(const std::string& key, float val);
+	void setOverride(const std::string& key, const std::string& val);
+
+	// Stage runs on own thread - only one job of the session can run at a time
+	// and functions changing the session throw until the job is finished
+	Job* startJob(const std::function<void(JobControl&)>& stage, ProgressCallback callback, void* userData);
+	// Stage runs on the calling thread as the job of the session
+	void runStage(const std::function<void(JobControl&)>& stage);
+
+	void buildMap(JobControl& control);
+	void beginTileScan(float startX, float startY, float stepX, float stepY, int countX, int countY,
+		int tileRows, int tileCols);
+	void addTile(const unsigned char* pixels, int rows, int cols, int stride, float x, float y, float z);
+	void finalizeTileScan();
+	void printValueAtTruncatedPos(float x, float y, float z);
+	void saveStiched();
+	void detectCapillaries(JobControl& control);
+	void describeCapillaries(JobControl& control);
+	void sweepParameters(const std::string& grid, JobControl& control);
+	void processMap(JobControl& control);
+	size_t getLayersNum();
+	int getBestLayerIndex();
+
+	void loadPositionsZ();
+	void buildSequence();
+	void saveProjections();
+	void calculateDepth(JobControl& control);
+	void validateCalibration(JobControl& control);
+
+	void initFocusLock();
+	void loadFocusLockCalibration(const std::string& calibrationFilename);
+	void setFocusLockCalibration(float slope, float offset);
+	float processFocusLockFrame(const unsigned char* pixels, int rows, int cols, int stride);
+	LatencyPercentiles getFocusLockLatency();
+
+private:
+	Config m_config;
+
+	Map m_map;
+	LayerScanner m_layerScanner;
+	std::vector<LayerInfo> m_layersWithCapillaries;
+	CapillaryProcessor m_capillaryProcessor;
+	ParameterSweep m_parameterSweep;
+	LayerPipeline m_layerPipeline;
+	int m_bestLayerIndex;
+
+	Sequence m_sequence;
+	std::vector<float> m_positionsZ;
+	LineImageProcessor m_lineImageProcessor;
+	WideImageProcessor m_wideImageProcessor;
+	SpectrumAnalyzer m_spectrumAnalyzer;
+	FocusEvaluator m_focusEvaluator;
+	MarkerCache m_markerCache;
+	CalibrationEngine m_calibrationEngine;
+	FocusLock m_focusLock;
+
+	std::atomic<bool> m_isJobRunning;
+
+private:
+	void checkNoJobRunning();
+	void selectBestLayer(const std::string& outputFolderNameMap);
+};
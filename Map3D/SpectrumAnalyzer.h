@@ -1,17 +1,17 @@
 #pragma once
 
+#include <atomic>
+#include <future>
+#include <thread>
 #include <vector>
 #include <complex>
 
-#include "../simple_fft/fft_settings.h"
-#include "../simple_fft/fft.h"
 #include "ByteMatrix.h"
+#include "FFTEngine.h"
+#include "Job.h"
 
 #pragma warning(disable: 26812)
 
-typedef std::vector<std::vector<real_type>> RealArray2D;
-typedef std::vector<std::vector<complex_type>> ComplexArray2D;
-
 enum AreaType
 {
 	NOTHING,
@@ -19,135 +19,242 @@ enum AreaType
 	CENTRAL
 };
 
+// Bin of spectrum within one of the energy areas
+struct EnergyBin
+{
+	size_t row;
+	size_t col;
+	AreaType areaType;
+};
+
+// FFT buffers and energy bins of one thread, energy bins are prepared for the image size
+struct SpectrumWorkspace
+{
+	FFTEngine fftEngine;
+	std::vector<EnergyBin> energyBins;
+	size_t binsRows = 0;
+	size_t binsCols = 0;
+};
+
 class SpectrumAnalyzer
 {
 public:
 	SpectrumAnalyzer()
 	{
-		m_rows = 0;
-		m_cols = 0;
 		m_sizeFFT = 0;
 		m_sizeEnergy = 0;
 		m_normalization = 0.0;
+		m_isBitmapOutput = false;
 	}
 
-	void init(Config& config)
+	void init(const ConfigSnapshot& config)
 	{
 		initConfig(config);
+		initWorkspace(m_workspace);
 	}
 
-	void calculateSpectrum(const std::string& imagesFolderName, const std::string& outputFolderName,
-		std::vector<float>& positionsZ)
+	// Energy values are returned to be reused by calibration
+	std::vector<float> calculateSpectrum(const std::string& imagesFolderName, const std::string& outputFolderName,
+		std::vector<float>& positionsZ, JobControl& control)
 	{
 		std::filesystem::path inputFolder = std::filesystem::absolute(std::filesystem::path(imagesFolderName));
 		std::string absFolderName = inputFolder.generic_string();
 		std::replace(absFolderName.begin(), absFolderName.end(), '/', '\\');
 		std::cout << "Input data folder:" << std::endl << absFolderName << std::endl << std::endl;
 
-		const size_t filenameSize = 32;
-		char inputFilename[filenameSize];
-		createFoldersIfNeed(outputFolderName, "SpectrumFFT");
-
-		std::vector<float> energyValues;
-		for (size_t fileIndex = 0; fileIndex < positionsZ.size(); fileIndex++)
+		if (m_isBitmapOutput)
 		{
-			sprintf_s(inputFilename, filenameSize, "Bright%4d.tif", (int)fileIndex);
-			cv::Mat wideImage = cv::imread(imagesFolderName + "/" + inputFilename, cv::IMREAD_GRAYSCALE);
-
-			m_rows = (size_t)wideImage.rows;
-			m_cols = (size_t)wideImage.cols;
-			cv::Mat wideSpectrum(wideImage.rows, wideImage.cols, CV_8U);
-
-			float energyDiff = calculateFFT(wideImage, wideSpectrum);
-			energyValues.push_back(energyDiff);
+			createFoldersIfNeed(outputFolderName, "SpectrumFFT");
+		}
 
-			std::string spectrumFilename = outputFolderName + "/SpectrumFFT/Spectrum" +
-				std::to_string(fileIndex) + ".bmp";
-			bool result = cv::imwrite(spectrumFilename, wideSpectrum);
-			if (!result)
-			{
-				throw std::exception(("Cannot write file: " + spectrumFilename).c_str());
-			}
+		// Each task takes the next frame and processes it with own workspace, energy is stored by frame index
+		size_t framesNum = positionsZ.size();
+		size_t tasksNum = std::min((size_t)std::max(std::thread::hardware_concurrency(), 1U), framesNum);
+		std::vector<float> energyValues(framesNum);
+		std::atomic<size_t> nextFileIndex = 0;
+		std::vector<std::future<void>> futures;
+		control.startStage("Processing of images", framesNum);
+		for (size_t taskIndex = 0; taskIndex < tasksNum; taskIndex++)
+		{
+			futures.push_back(std::async(std::launch::async, [&]()
+				{
+					SpectrumWorkspace workspace;
+					initWorkspace(workspace);
+					for (size_t fileIndex = nextFileIndex++; fileIndex < framesNum; fileIndex = nextFileIndex++)
+					{
+						control.checkCancelled();
+						energyValues[fileIndex] = processFrame(workspace, imagesFolderName, outputFolderName, fileIndex);
+						control.advance();
+					}
+				}));
+		}
+		for (std::future<void>& future : futures)
+		{
+			future.get();
 		}
 
 		RegressionResult result = calculateRegression(energyValues, positionsZ);
 		saveResults(positionsZ, energyValues, result, outputFolderName);
+		return energyValues;
+	}
+
+	// Difference of spectral energy in corners and in center of the image, spectrum of the image size
+	// is filled only if bitmaps are written
+	float calculateEnergyDiff(cv::Mat& wideImage, cv::Mat& wideSpectrum)
+	{
+		return calculateEnergyDiff(m_workspace, wideImage, wideSpectrum);
 	}
 
 private:
-	size_t m_rows;
-	size_t m_cols;
+	// Workspace of calls from the owner thread
+	SpectrumWorkspace m_workspace;
 
 	// Parameters from configuration
 	size_t m_sizeFFT;
 	size_t m_sizeEnergy;
 	double m_normalization;
+	bool m_isBitmapOutput;
 
 private:
-	void initConfig(Config& config)
+	void initConfig(const ConfigSnapshot& config)
 	{
 		// Get parameters from configuration
-		m_sizeFFT		= (size_t)config.getIntValue(keySpectrumSizeFFT);
-		m_sizeEnergy	= (size_t)config.getIntValue(keySpectrumSizeEnergy);
-		m_normalization	= (double)config.getFloatValue(keySpectrumNormalization);
+		m_sizeFFT			= config.focusing.spectrumSizeFFT;
+		m_sizeEnergy		= config.focusing.spectrumSizeEnergy;
+		m_normalization		= config.focusing.spectrumNormalization;
+		m_isBitmapOutput	= config.focusing.isSpectrumBitmapOutput;
 	}
 
-	float calculateFFT(cv::Mat& src, cv::Mat& dst)
+	void initWorkspace(SpectrumWorkspace& workspace)
 	{
-		size_t rowBegin = (m_sizeFFT - m_rows) / 2;
-		size_t colBegin = (m_sizeFFT - m_cols) / 2;
+		workspace.fftEngine.init(m_sizeFFT);
+		workspace.energyBins.clear();
+		workspace.binsRows = 0;
+		workspace.binsCols = 0;
+	}
+
+	float processFrame(SpectrumWorkspace& workspace, const std::string& imagesFolderName,
+		const std::string& outputFolderName, size_t fileIndex)
+	{
+		const size_t filenameSize = 32;
+		char inputFilename[filenameSize];
+		sprintf_s(inputFilename, filenameSize, "Bright%4d.tif", (int)fileIndex);
+		cv::Mat wideImage = cv::imread(imagesFolderName + "/" + inputFilename, cv::IMREAD_GRAYSCALE);
+		cv::Mat wideSpectrum(wideImage.rows, wideImage.cols, CV_8U);
+
+		float energyDiff = calculateEnergyDiff(workspace, wideImage, wideSpectrum);
+		if (!m_isBitmapOutput)
+		{
+			return energyDiff;
+		}
+
+		std::string spectrumFilename = outputFolderName + "/SpectrumFFT/Spectrum" +
+			std::to_string(fileIndex) + ".bmp";
+		bool result = cv::imwrite(spectrumFilename, wideSpectrum);
+		if (!result)
+		{
+			throw std::exception(("Cannot write file: " + spectrumFilename).c_str());
+		}
+		return energyDiff;
+	}
 
-		RealArray2D matSrc;
-		ComplexArray2D matDst;
-		const char* errMsg = nullptr;
+	float calculateEnergyDiff(SpectrumWorkspace& workspace, cv::Mat& wideImage, cv::Mat& wideSpectrum)
+	{
+		size_t rows = (size_t)wideImage.rows;
+		size_t cols = (size_t)wideImage.cols;
+		if (m_isBitmapOutput)
+		{
+			return calculateFFT(workspace, wideImage, wideSpectrum);
+		}
 
-		for (size_t row = 0; row < m_sizeFFT; row++)
+		if ((rows != workspace.binsRows) || (cols != workspace.binsCols))
 		{
-			// Add empty destination row
-			std::vector<complex_type> rowDst;
-			rowDst.resize(m_sizeFFT);
-			matDst.push_back(rowDst);
+			prepareEnergyBins(workspace, rows, cols);
+		}
+		return calculateEnergy(workspace, wideImage);
+	}
 
-			// Source row: empty to pad for FFT size or contains source image data
-			std::vector<real_type> rowSrc;
-			rowSrc.resize(m_sizeFFT);
+	// Only columns of spectrum crossing the energy areas are transformed
+	void prepareEnergyBins(SpectrumWorkspace& workspace, size_t rows, size_t cols)
+	{
+		size_t rowBegin = (m_sizeFFT - rows) / 2;
+		size_t colBegin = (m_sizeFFT - cols) / 2;
 
-			// Add padding row of source if index of the row is out of image rows
-			if ((row < rowBegin) || (row >= rowBegin + m_rows))
+		workspace.energyBins.clear();
+		std::vector<size_t> energyCols;
+		for (size_t col = 0; col < cols; col++)
+		{
+			bool isEnergyCol = false;
+			for (size_t row = 0; row < rows; row++)
 			{
-				matSrc.push_back(rowSrc);
-				continue;
+				AreaType areaType = getAreaType(row, col, rows, cols);
+				if (areaType != AreaType::NOTHING)
+				{
+					workspace.energyBins.push_back(EnergyBin{ row + rowBegin, col + colBegin, areaType });
+					isEnergyCol = true;
+				}
 			}
-
-			// Fill and add source row that contains pixels of the image
-			for (size_t col = colBegin; col < colBegin + m_cols; col++)
+			if (isEnergyCol)
 			{
-				byte val = src.at<byte>((int)(row - rowBegin), (int)(col - colBegin));
-				rowSrc[col] = (real_type)val;
+				energyCols.push_back(col + colBegin);
 			}
-			matSrc.push_back(rowSrc);
 		}
 
-		bool result = simple_fft::FFT<RealArray2D, ComplexArray2D>(matSrc, matDst, m_sizeFFT, m_sizeFFT, errMsg);
-		if (!result)
+		workspace.fftEngine.restrictColumns(energyCols);
+		workspace.binsRows = rows;
+		workspace.binsCols = cols;
+	}
+
+	float calculateEnergy(SpectrumWorkspace& workspace, cv::Mat& src)
+	{
+		size_t rowBegin = (m_sizeFFT - (size_t)src.rows) / 2;
+		size_t colBegin = (m_sizeFFT - (size_t)src.cols) / 2;
+		workspace.fftEngine.transform(src, rowBegin, colBegin);
+
+		float energyCorners = 0.0F;
+		float energyCentral = 0.0F;
+		for (const EnergyBin& bin : workspace.energyBins)
 		{
-			std::cout << "FFT: " << errMsg << std::endl << std::endl;
-			return 0.0F;
+			complexf val = workspace.fftEngine.getBin(bin.row, bin.col);
+			double valReal = std::round(std::abs((double)val.real())) / m_normalization;
+			double valNorm = std::min(valReal, (double)WHITE);
+			if (bin.areaType == AreaType::CORNERS)
+			{
+				energyCorners += (float)valNorm;
+			}
+			else
+			{
+				energyCentral += (float)valNorm;
+			}
 		}
 
+		float energyDiff = (energyCorners - energyCentral) / 4.0F / m_sizeEnergy / m_sizeEnergy;
+		return std::fmaxf(0.0F, energyDiff);
+	}
+
+	float calculateFFT(SpectrumWorkspace& workspace, cv::Mat& src, cv::Mat& dst)
+	{
+		size_t rows = (size_t)src.rows;
+		size_t cols = (size_t)src.cols;
+		size_t rowBegin = (m_sizeFFT - rows) / 2;
+		size_t colBegin = (m_sizeFFT - cols) / 2;
+		workspace.fftEngine.unrestrictColumns();
+		workspace.binsRows = 0;
+		workspace.binsCols = 0;
+		workspace.fftEngine.transform(src, rowBegin, colBegin);
+
 		float energyCorners = 0.0F;
 		float energyCentral = 0.0F;
-		for (size_t row = rowBegin; row < rowBegin + m_rows; row++)
+		for (size_t row = rowBegin; row < rowBegin + rows; row++)
 		{
-			std::vector<complex_type> rowDst = matDst[row];
-			for (size_t col = colBegin; col < colBegin + m_cols; col++)
+			for (size_t col = colBegin; col < colBegin + cols; col++)
 			{
-				complex_type val = rowDst[col];
-				real_type valReal = std::round(std::abs(val.real())) / m_normalization;
-				real_type valNorm = std::min(valReal, (real_type)WHITE);
+				complexf val = workspace.fftEngine.getBin(row, col);
+				double valReal = std::round(std::abs((double)val.real())) / m_normalization;
+				double valNorm = std::min(valReal, (double)WHITE);
 				dst.at<byte>((int)(row - rowBegin), (int)(col - colBegin)) = (byte)valNorm;
 
-				AreaType areaType = getAreaType(row - rowBegin, col - colBegin);
+				AreaType areaType = getAreaType(row - rowBegin, col - colBegin, rows, cols);
 				if (areaType == AreaType::CORNERS)
 				{
 					energyCorners += (float)valNorm;
@@ -163,17 +270,17 @@ private:
 		return std::fmaxf(0.0F, energyDiff);
 	}
 
-	AreaType getAreaType(size_t row, size_t col)
+	AreaType getAreaType(size_t row, size_t col, size_t rows, size_t cols)
 	{
-		bool rowInCornersArea = (row < m_sizeEnergy) || (row >= m_rows - m_sizeEnergy);
-		bool colInCornersArea = (col < m_sizeEnergy) || (col >= m_cols - m_sizeEnergy);
+		bool rowInCornersArea = (row < m_sizeEnergy) || (row >= rows - m_sizeEnergy);
+		bool colInCornersArea = (col < m_sizeEnergy) || (col >= cols - m_sizeEnergy);
 		if (rowInCornersArea && colInCornersArea)
 		{
 			return AreaType::CORNERS;
 		}
 
-		bool rowInCentralArea = std::abs((int)row - (int)m_rows / 2) < (int)m_sizeEnergy;
-		bool colInCentralArea = std::abs((int)col - (int)m_cols / 2) < (int)m_sizeEnergy;
+		bool rowInCentralArea = std::abs((int)row - (int)rows / 2) < (int)m_sizeEnergy;
+		bool colInCentralArea = std::abs((int)col - (int)cols / 2) < (int)m_sizeEnergy;
 		if (rowInCentralArea && colInCentralArea)
 		{
 			return AreaType::CENTRAL;
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+	Scoped spans of processing exported in Chrome Trace Event format (chrome://tracing, Perfetto).
+	Spans are compiled only with MAP_TRACING defined and recorded only while tracing is started.
+	Each thread records to own ring buffer without locks, so only the newest spans are kept per thread.
+	Buffers are never cleared: spans of previous runs of tracing are skipped by the generation of the run.
+	Names of spans must be string literals - only the pointer is recorded.
+*/
+
+// Spans kept per thread before the oldest ones are overwritten
+const size_t TRACE_BUFFER_SIZE = 65536;
+
+struct TraceSpan
+{
+	const char* name;
+	long long startNanoseconds;
+	long long durationNanoseconds;
+	size_t threadId;
+	size_t depth;
+	size_t generation;
+};
+
+// Written only by the owner thread, read by export when no stage is running
+class TraceBuffer
+{
+public:
+	TraceBuffer()
+	{
+		m_spans.resize(TRACE_BUFFER_SIZE);
+		m_spansNum = 0;
+	}
+
+	void record(const TraceSpan& span)
+	{
+		size_t spansNum = m_spansNum.load(std::memory_order_relaxed);
+		m_spans[spansNum % TRACE_BUFFER_SIZE] = span;
+		m_spansNum.store(spansNum + 1, std::memory_order_release);
+	}
+
+	void collect(std::vector<TraceSpan>& spans)
+	{
+		size_t spansNum = m_spansNum.load(std::memory_order_acquire);
+		size_t firstIndex = (spansNum > TRACE_BUFFER_SIZE) ? spansNum - TRACE_BUFFER_SIZE : 0;
+		for (size_t index = firstIndex; index < spansNum; index++)
+		{
+			spans.push_back(m_spans[index % TRACE_BUFFER_SIZE]);
+		}
+	}
+
+private:
+	std::vector<TraceSpan> m_spans;
+	std::atomic<size_t> m_spansNum;
+};
+
+class Tracer
+{
+public:
+	// Spans which are open while tracing is restarted belong to the previous run and are dropped
+	static void start()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_isEnabled.store(false, std::memory_order_release);
+		m_generation.fetch_add(1, std::memory_order_acq_rel);
+		m_originNanoseconds.store(getClockNanoseconds(), std::memory_order_release);
+		m_isEnabled.store(true, std::memory_order_release);
+	}
+
+	static void stop()
+	{
+		m_isEnabled.store(false, std::memory_order_release);
+	}
+
+	static bool isEnabled()
+	{
+		return m_isEnabled.load(std::memory_order_relaxed);
+	}
+
+	static size_t getGeneration()
+	{
+		return m_generation.load(std::memory_order_acquire);
+	}
+
+	// Time since tracing is started
+	static long long getNanoseconds()
+	{
+		return getClockNanoseconds() - m_originNanoseconds.load(std::memory_order_relaxed);
+	}
+
+	// Buffer and nesting depth of the calling thread
+	static TraceBuffer& getBuffer()
+	{
+		return *getThreadState().buffer;
+	}
+
+	static size_t& getDepth()
+	{
+		return getThreadState().depth;
+	}
+
+	static size_t getThreadId()
+	{
+		return getThreadState().threadId;
+	}
+
+	// Spans of the last run of all threads ordered by start time - written as complete events with microseconds
+	static void saveChromeTrace(const std::string& filename)
+	{
+		std::vector<TraceSpan> spans;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (std::shared_ptr<TraceBuffer>& buffer : m_buffers)
+			{
+				buffer->collect(spans);
+			}
+		}
+		size_t generation = getGeneration();
+		spans.erase(std::remove_if(spans.begin(), spans.end(), [generation](const TraceSpan& span) {
+			return (span.generation != generation) || (span.startNanoseconds < 0) || (span.durationNanoseconds < 0);
+		}), spans.end());
+		std::sort(spans.begin(), spans.end(), [](const TraceSpan& spanL, const TraceSpan& spanR) {
+			return spanL.startNanoseconds < spanR.startNanoseconds;
+		});
+
+		std::ofstream file(filename);
+		if (!file.is_open())
+		{
+			throw std::exception(("Cannot create trace file: " + filename).c_str());
+		}
+		file << "{\"traceEvents\":[" << std::endl;
+		for (size_t spanIndex = 0; spanIndex < spans.size(); spanIndex++)
+		{
+			const TraceSpan& span = spans[spanIndex];
+			file << "{\"name\":\"" << span.name << "\",\"ph\":\"X\",\"pid\":1" <<
+				",\"tid\":" << span.threadId <<
+				",\"ts\":" << toMicroseconds(span.startNanoseconds) <<
+				",\"dur\":" << toMicroseconds(span.durationNanoseconds) <<
+				",\"args\":{\"depth\":" << span.depth << "}}" <<
+				((spanIndex + 1 < spans.size()) ? "," : "") << std::endl;
+		}
+		file << "],\"displayTimeUnit\":\"ms\"}" << std::endl;
+		file.close();
+	}
+
+private:
+	// Buffer of the finished thread is reused by the next new thread
+	struct ThreadState
+	{
+		std::shared_ptr<TraceBuffer> buffer;
+		size_t threadId;
+		size_t depth;
+
+		ThreadState()
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_freeBuffers.empty())
+			{
+				buffer = std::make_shared<TraceBuffer>();
+				m_buffers.push_back(buffer);
+			}
+			else
+			{
+				buffer = m_freeBuffers.back();
+				m_freeBuffers.pop_back();
+			}
+			threadId = ++m_threadsNum;
+			depth = 0;
+		}
+
+		~ThreadState()
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_freeBuffers.push_back(buffer);
+		}
+	};
+
+	// Non-negative nanoseconds as decimal microseconds
+	static std::string toMicroseconds(long long nanoseconds)
+	{
+		std::ostringstream stream;
+		stream << nanoseconds / 1000 << "." << std::setw(3) << std::setfill('0') << nanoseconds % 1000;
+		return stream.str();
+	}
+
+	static long long getClockNanoseconds()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static ThreadState& getThreadState()
+	{
+		thread_local ThreadState threadState;
+		return threadState;
+	}
+
+	static inline std::atomic<bool> m_isEnabled = false;
+	static inline std::atomic<size_t> m_generation = 0;
+	static inline std::atomic<long long> m_originNanoseconds = 0;
+	static inline std::mutex m_mutex;
+	static inline std::vector<std::shared_ptr<TraceBuffer>> m_buffers;
+	static inline std::vector<std::shared_ptr<TraceBuffer>> m_freeBuffers;
+	static inline size_t m_threadsNum = 0;
+};
+
+// Span from construction to destruction - nothing is recorded while tracing is stopped
+class TraceScope
+{
+public:
+	TraceScope(const char* name)
+	{
+		m_name = name;
+		m_isRecorded = Tracer::isEnabled();
+		if (m_isRecorded)
+		{
+			m_generation = Tracer::getGeneration();
+			m_depth = Tracer::getDepth()++;
+			m_startNanoseconds = Tracer::getNanoseconds();
+		}
+	}
+
+	~TraceScope()
+	{
+		if (m_isRecorded)
+		{
+			long long endNanoseconds = Tracer::getNanoseconds();
+			Tracer::getDepth()--;
+			if (Tracer::getGeneration() != m_generation)
+			{
+				return;
+			}
+			Tracer::getBuffer().record({ m_name, m_startNanoseconds, endNanoseconds - m_startNanoseconds,
+				Tracer::getThreadId(), m_depth, m_generation });
+		}
+	}
+
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+	const char* m_name;
+	bool m_isRecorded;
+	size_t m_depth = 0;
+	size_t m_generation = 0;
+	long long m_startNanoseconds = 0;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef MAP_TRACING
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name)
+#endif
@@ -1,20 +1,11 @@
 #include "Utils.h"
 
-void initGeneralData(Config& config)
-{
-	pixelsInMm = (size_t)config.getIntValue(keyPixelsInMm);
-	grayLevelOriginalMin = (byte)config.getIntValue(keyGrayLevelOriginalMin);
-	grayLevelOriginalMax = (byte)config.getIntValue(keyGrayLevelOriginalMax);
-	grayLevelProcessedMin = (byte)config.getIntValue(keyGrayLevelProcessedMin);
-	grayLevelProcessedMax = (byte)config.getIntValue(keyGrayLevelProcessedMax);
-}
-
-size_t mm2pixels(float mm)
+size_t mm2pixels(float mm, size_t pixelsInMm)
 {
 	return (size_t)std::roundf(pixelsInMm * mm);
 }
 
-float pixels2mm(size_t pixels)
+float pixels2mm(size_t pixels, size_t pixelsInMm)
 {
 	return (float)pixels / pixelsInMm;
 }
@@ -34,18 +25,6 @@ float makeCentrosymmetric(float angleRadians)
 	return angleRadians + (float)std::numbers::pi;
 }
 
-// Examine gray level to find possible capillary corner - performed on raw image
-bool isValidGrayLevelOriginal(byte val)
-{
-	return (grayLevelOriginalMin <= val) && (val <= grayLevelOriginalMax);
-}
-
-// Examine gray level to find limit of capillary - performed on processed image
-bool isValidGrayLevelProcessed(byte val)
-{
-	return (grayLevelProcessedMin <= val) && (val <= grayLevelProcessedMax);
-}
-
 std::string toString(const float val, const int n)
 {
 	std::ostringstream out;
@@ -120,22 +99,12 @@ RegressionResult calculateRegression(std::vector<float>& imageMarkers, std::vect
 		throw std::exception("Data sizes mismatch");
 	}
 
-	float sumX1 = 0.0F;
-	float sumX2 = 0.0F;
-	float sumY1 = 0.0F;
-	float sumXY = 0.0F;
+	RegressionAccumulator accumulator;
 	for (size_t i = 0; i < n; i++)
 	{
-		sumX1 += imageMarkers[i];
-		sumX2 += imageMarkers[i] * imageMarkers[i];
-		sumY1 += positionsZ[i];
-		sumXY += imageMarkers[i] * positionsZ[i];
+		accumulator.add(imageMarkers[i], positionsZ[i]);
 	}
-
-	RegressionResult result{};
-	result.slope = (n * sumXY - sumX1 * sumY1) / (n * sumX2 - sumX1 * sumX1);
-	result.offset = (sumX2 * sumY1 - sumXY * sumX1) / (n * sumX2 - sumX1 * sumX1);
-	return result;
+	return accumulator.fit();
 }
 
 void saveResults(std::vector<float>& positionsZ, std::vector<float>& modeIndices,
@@ -157,3 +126,23 @@ void saveResults(std::vector<float>& positionsZ, std::vector<float>& modeIndices
 
 	positionsFile.close();
 }
+
+// Regression and the table of image markers at given Z positions to be loaded by focus lock
+void saveCalibration(std::vector<float>& positionsZ, std::vector<float>& imageMarkers,
+	RegressionResult& result, const std::string& outputFolderName)
+{
+	std::string calibrationFilename = outputFolderName + "/Calibration.csv";
+	std::ofstream calibrationFile(calibrationFilename);
+	calibrationFile << "Slope,Offset" << std::endl;
+	calibrationFile << result.slope << "," << result.offset << std::endl;
+	calibrationFile << "Marker,Z" << std::endl;
+
+	for (size_t posIndex = 0; posIndex < positionsZ.size(); posIndex++)
+	{
+		calibrationFile <<
+			imageMarkers[posIndex] << "," <<
+			positionsZ[posIndex] << std::endl;
+	}
+
+	calibrationFile.close();
+}
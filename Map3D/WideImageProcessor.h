@@ -2,9 +2,13 @@
 
 
 #include <vector>
+#include <numeric>
 #include <fstream>
+#include <execution>
 
 #include "Sequence.h"
+#include "HistogramEngine.h"
+#include "Job.h"
 
 #pragma warning(disable: 26812)
 
@@ -17,153 +21,119 @@ enum ImageMarkerType
 class WideImageProcessor
 {
 public:
-	void calculateStatistics(const std::string& imagesFolderName, const std::string& outputFolderName,
-		std::vector<float>& positionsZ, ImageMarkerType imageMarkerType, Config& config)
+	// Image markers are returned to be reused by calibration
+	std::vector<float> calculateStatistics(const std::string& imagesFolderName, const std::string& outputFolderName,
+		std::vector<float>& positionsZ, ImageMarkerType imageMarkerType, const ConfigSnapshot& config, JobControl& control)
 	{
 		std::filesystem::path inputFolder = std::filesystem::absolute(std::filesystem::path(imagesFolderName));
 		std::string absFolderName = inputFolder.generic_string();
 		std::replace(absFolderName.begin(), absFolderName.end(), '/', '\\');
 		std::cout << "Input data folder:" << std::endl << absFolderName << std::endl << std::endl;
 
-		const size_t filenameSize = 32;
-		char inputFilename[filenameSize];
 		createFoldersIfNeed(outputFolderName, "Histogram");
 
-		std::string statisticsFilename = outputFolderName + "/Histogram/Statistics.csv";
-		std::ofstream statisticsFile(statisticsFilename);
+		std::vector<ImageStatistics> imagesStatistics = processImages(imagesFolderName, outputFolderName,
+			positionsZ.size(), imageMarkerType, config, control);
 
 		std::vector<float> imageMarkers;
-		for (size_t fileIndex = 0; fileIndex < positionsZ.size(); fileIndex++)
+		for (const ImageStatistics& imageStatistics : imagesStatistics)
 		{
-			sprintf_s(inputFilename, filenameSize, "Bright%4d.tif", (int)fileIndex);
-			cv::Mat wideImage = cv::imread(imagesFolderName + "/" + inputFilename, cv::IMREAD_GRAYSCALE);
-
-			std::string histogramFilename = outputFolderName + "/Histogram/Histogram" +
-				std::to_string(fileIndex) + ".csv";
-			std::ofstream histogramFile(histogramFilename);
-
-			float imageMarker = getImageMarker(wideImage, imageMarkerType,
-				histogramFile, statisticsFile, config);
-			histogramFile.close();
-			imageMarkers.push_back(imageMarker);
+			imageMarkers.push_back(getImageMarker(imageStatistics, imageMarkerType));
 		}
 
-		statisticsFile.close();
-
 		RegressionResult result = calculateRegression(imageMarkers, positionsZ);
 		saveResults(positionsZ, imageMarkers, result, outputFolderName);
+		saveCalibration(positionsZ, imageMarkers, result, outputFolderName);
+		return imageMarkers;
 	}
 
-	void calculateStatisticsHalf(const std::string& imagesFolderName, const std::string& outputFolderName,
-		std::vector<float>& positionsZ, ImageMarkerType imageMarkerType, Config& config)
+private:
+	// Read and process images in parallel, then write their statistics in order of the images
+	std::vector<ImageStatistics> processImages(const std::string& imagesFolderName,
+		const std::string& outputFolderName, size_t imagesNum, ImageMarkerType imageMarkerType, const ConfigSnapshot& config,
+		JobControl& control)
 	{
-		std::filesystem::path inputFolder = std::filesystem::absolute(std::filesystem::path(imagesFolderName));
-		std::string absFolderName = inputFolder.generic_string();
-		std::replace(absFolderName.begin(), absFolderName.end(), '/', '\\');
-		std::cout << "Input data folder:" << std::endl << absFolderName << std::endl << std::endl;
-
-		const size_t filenameSize = 32;
-		char inputFilename[filenameSize];
-		createFoldersIfNeed(outputFolderName, "Histogram");
+		size_t imagePartCenter = (imageMarkerType == ImageMarkerType::GRAY_LEVEL_MODE) ?
+			config.focusing.modeImagePartCenter :
+			config.focusing.varianceImagePartCenter;
+
+		std::vector<ImageStatistics> imagesStatistics(imagesNum);
+		std::vector<size_t> fileIndices(imagesNum);
+		std::iota(fileIndices.begin(), fileIndices.end(), 0);
+		control.startStage("Processing of images", imagesNum);
+		std::for_each(std::execution::par, fileIndices.begin(), fileIndices.end(), [&](size_t fileIndex)
+			{
+				// Exception cannot leave parallel algorithm - remaining images are skipped
+				if (control.isCancelled())
+				{
+					return;
+				}
+
+				const size_t filenameSize = 32;
+				char inputFilename[filenameSize];
+				sprintf_s(inputFilename, filenameSize, "Bright%4d.tif", (int)fileIndex);
+				cv::Mat wideImage = cv::imread(imagesFolderName + "/" + inputFilename, cv::IMREAD_GRAYSCALE);
+				imagesStatistics[fileIndex] = HistogramEngine::calculateStatistics(wideImage, imagePartCenter);
+				control.advance();
+			});
+		control.checkCancelled();
 
-		std::string statisticsFilename = outputFolderName + "/Histogram/StatisticsHalf.csv";
+		std::string statisticsFilename = outputFolderName + "/Histogram/Statistics.csv";
 		std::ofstream statisticsFile(statisticsFilename);
-
-		std::vector<float> positionsCalcZ;
-		std::vector<float> positionsTestZ;
-		std::vector<float> imageMarkersCalc;
-		std::vector<float> imageMarkersTest;
-		for (size_t fileIndex = 0; fileIndex < positionsZ.size(); fileIndex++)
+		for (const ImageStatistics& imageStatistics : imagesStatistics)
 		{
-			sprintf_s(inputFilename, filenameSize, "Bright%4d.tif", (int)fileIndex);
-			cv::Mat wideImage = cv::imread(imagesFolderName + "/" + inputFilename, cv::IMREAD_GRAYSCALE);
-
-			std::string histogramFilename = outputFolderName + "/Histogram/HistogramHalf" +
-				std::to_string(fileIndex) + ".csv";
-			std::ofstream histogramFile(histogramFilename);
-
-			float imageMarker = getImageMarker(wideImage, imageMarkerType,
-				histogramFile, statisticsFile, config);
-			histogramFile.close();
-
-			if (fileIndex % 2 == 0)
-			{
-				positionsCalcZ.push_back(positionsZ[fileIndex]);
-				imageMarkersCalc.push_back(imageMarker);
-			}
-			else
-			{
-				positionsTestZ.push_back(positionsZ[fileIndex]);
-				imageMarkersTest.push_back(imageMarker);
-			}
+			statisticsFile <<
+				imageStatistics.modeGrayLevelIndex << "," <<
+				imageStatistics.modeGrayLevelValue << "," <<
+				imageStatistics.variance << "," <<
+				imageStatistics.standardDeviation << std::endl;
 		}
-
 		statisticsFile.close();
 
-		RegressionResult result = calculateRegression(imageMarkersCalc, positionsCalcZ);
-		saveResults(positionsTestZ, imageMarkersTest, result, outputFolderName, true);
+		writeHistograms(imagesStatistics, outputFolderName, config.focusing.histogramOutputType);
+		return imagesStatistics;
 	}
 
-private:
-	float getImageMarker(cv::Mat& image, ImageMarkerType imageMarkerType,
-		std::ofstream& histogramFile, std::ofstream& statisticsFile, Config& config)
+	void writeHistograms(const std::vector<ImageStatistics>& imagesStatistics,
+		const std::string& outputFolderName, HistogramOutputType histogramOutputType)
 	{
-		size_t rows = image.rows;
-		size_t cols = image.cols;
-
-		size_t imagePartCenter = (imageMarkerType == ImageMarkerType::GRAY_LEVEL_MODE) ?
-			(size_t)config.getIntValue(keyModeImagePartCenter) :
-			(size_t)config.getIntValue(keyVarianceImagePartCenter);
-		size_t imageMargin = imagePartCenter / 2;
-
-		size_t rowCenterL = imageMargin * rows / imagePartCenter;
-		size_t rowCenterR = (imageMargin + 1) * rows / imagePartCenter;
-		size_t colCenterL = imageMargin / imagePartCenter;
-		size_t colCenterR = (imageMargin + 1) * cols / imagePartCenter;
-
-		size_t pixelsNum = (rowCenterR - rowCenterL) * (colCenterR - colCenterL);
-
-		size_t histogram[WHITE + 1];
-		memset(histogram, 0, sizeof(histogram));
-
-		for (size_t row = rowCenterL; row < rowCenterR; row++)
+		// Separate file for each image: value of each gray level in line
+		if (histogramOutputType == HistogramOutputType::HISTOGRAM_PER_FRAME)
 		{
-			for (size_t col = colCenterL; col < colCenterR; col++)
+			for (size_t fileIndex = 0; fileIndex < imagesStatistics.size(); fileIndex++)
 			{
-				byte val = image.at<byte>((int)row, (int)col);
-				histogram[val]++;
+				std::string histogramFilename = outputFolderName + "/Histogram/Histogram" +
+					std::to_string(fileIndex) + ".csv";
+				std::ofstream histogramFile(histogramFilename);
+				for (size_t valueGrayLevel : imagesStatistics[fileIndex].histogram)
+				{
+					histogramFile << valueGrayLevel << std::endl;
+				}
+				histogramFile.close();
 			}
 		}
 
-		size_t modeGrayLevelIndex = 0;
-		size_t modeGrayLevelValue = 0;
-		size_t sum1GrayLevelValue = 0;
-		size_t sum2GrayLevelValue = 0;
-		for (size_t indexGrayLevel = BLACK; indexGrayLevel <= WHITE; indexGrayLevel++)
+		// Single file for all images: histogram of each image in line
+		if (histogramOutputType == HistogramOutputType::HISTOGRAM_BATCHED)
 		{
-			size_t valueGrayLevel = histogram[indexGrayLevel];
-			if (valueGrayLevel > modeGrayLevelValue)
+			std::string histogramsFilename = outputFolderName + "/Histogram/Histograms.csv";
+			std::ofstream histogramsFile(histogramsFilename);
+			for (size_t fileIndex = 0; fileIndex < imagesStatistics.size(); fileIndex++)
 			{
-				modeGrayLevelIndex = indexGrayLevel;
-				modeGrayLevelValue = valueGrayLevel;
+				histogramsFile << fileIndex;
+				for (size_t valueGrayLevel : imagesStatistics[fileIndex].histogram)
+				{
+					histogramsFile << "," << valueGrayLevel;
+				}
+				histogramsFile << std::endl;
 			}
-			sum1GrayLevelValue += valueGrayLevel;
-			sum2GrayLevelValue += valueGrayLevel * valueGrayLevel;
-			histogramFile << valueGrayLevel << std::endl;
+			histogramsFile.close();
 		}
+	}
 
-		float expectation1 = (float)sum1GrayLevelValue / pixelsNum; // equals 1 by definition
-		float expectation2 = (float)sum2GrayLevelValue / pixelsNum;
-		float variance = expectation2 - expectation1 * expectation1;
-		float standardDeviation = std::sqrtf(variance);
-
-		statisticsFile <<
-			modeGrayLevelIndex << "," <<
-			modeGrayLevelValue << "," <<
-			variance << "," <<
-			standardDeviation << std::endl;
-
+	float getImageMarker(const ImageStatistics& imageStatistics, ImageMarkerType imageMarkerType)
+	{
 		return imageMarkerType == ImageMarkerType::GRAY_LEVEL_MODE ?
-			(float)modeGrayLevelIndex : variance;
+			(float)imageStatistics.modeGrayLevelIndex : imageStatistics.variance;
 	}
 };
@@ -13,6 +13,8 @@
 #include <cstddef>
 #include <math.h>
 #include <vector>
+#include <thread>
+#include <algorithm>
 
 using std::size_t;
 
@@ -90,6 +92,18 @@ inline void scaleValues<std::vector<complex_type> >(std::vector<complex_type> &
     }
 }
 
+// NOTE: explicit template specialization for the case of raw pointer to contiguous
+// memory used by 2D FFT for its scratch buffers
+template <>
+inline void scaleValues<complex_type*>(complex_type* & data, const size_t num_elements)
+{
+    real_type mult = 1.0 / num_elements;
+
+    for(size_t i = 0; i < num_elements; ++i) {
+        data[i] *= mult;
+    }
+}
+
 template <class TComplexArray1D>
 inline void bufferExchangeHelper(TComplexArray1D & data, const size_t index_from,
                                  const size_t index_to, complex_type & buf)
@@ -121,6 +135,17 @@ inline void bufferExchangeHelper<std::vector<complex_type> >(std::vector<complex
     data[index_to]= buf;
 }
 
+template <>
+inline void bufferExchangeHelper<complex_type*>(complex_type* & data,
+                                                const size_t index_from,
+                                                const size_t index_to,
+                                                complex_type & buf)
+{
+    buf = data[index_from];
+    data[index_from] = data[index_to];
+    data[index_to]= buf;
+}
+
 template <class TComplexArray1D>
 void rearrangeData(TComplexArray1D & data, const size_t num_elements)
 {
@@ -186,6 +211,18 @@ inline void fftTransformHelper<std::vector<complex_type> >(std::vector<complex_t
     data[k] += product;
 }
 
+template <>
+inline void fftTransformHelper<complex_type*>(complex_type* & data,
+                                              const size_t match,
+                                              const size_t k,
+                                              complex_type & product,
+                                              const complex_type factor)
+{
+    product = data[match] * factor;
+    data[match] = data[k] - product;
+    data[k] += product;
+}
+
 template <class TComplexArray1D>
 bool makeTransform(TComplexArray1D & data, const size_t num_elements,
                    const FFT_direction fft_direction, const char *& error_description)
@@ -275,6 +312,53 @@ struct CFFT<TComplexArray1D,1>
     }
 };
 
+// Number of adjacent columns transposed together by 2D FFT: a block row of
+// source spans whole cache lines
+const size_t TRANSPOSE_BLOCK_SIZE = 32;
+
+// Smaller 2D transforms are not worth starting threads
+const size_t PARALLEL_MIN_ELEMENTS = 64 * 1024;
+
+// Calls func(begin, end) for consecutive chunks of [0, num_items) in parallel
+// threads, each item has item_size elements
+template <class TFunc>
+void parallelFor(const size_t num_items, const size_t item_size, TFunc func)
+{
+    size_t num_threads = std::thread::hardware_concurrency();
+    if ((num_threads < 2) || (num_items < 2) || (num_items * item_size < PARALLEL_MIN_ELEMENTS)) {
+        func(size_t(0), num_items);
+        return;
+    }
+
+    num_threads = std::min(num_threads, num_items);
+    size_t chunk = (num_items + num_threads - 1) / num_threads;
+    std::vector<std::thread> threads;
+    for(size_t begin = 0; begin < num_items; begin += chunk) {
+        threads.emplace_back(func, begin, std::min(begin + chunk, num_items));
+    }
+    for(size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+}
+
+// 1D FFTs of contiguous lines [line_begin, line_end) of the buffer; sizes and
+// direction are checked beforehand so the transforms cannot fail
+inline void transformLines(complex_type * buffer, const size_t line_size,
+                           const size_t line_begin, const size_t line_end,
+                           const FFT_direction fft_direction)
+{
+    const char * error_description = 0;
+    for(size_t line = line_begin; line < line_end; ++line)
+    {
+        complex_type * line_data = buffer + line * line_size;
+        rearrangeData(line_data, line_size);
+        makeTransform(line_data, line_size, fft_direction, error_description);
+        if (FFT_BACKWARD == fft_direction) {
+            scaleValues(line_data, line_size);
+        }
+    }
+}
+
 // 2D FFT
 template <class TComplexArray2D>
 struct CFFT<TComplexArray2D,2>
@@ -282,86 +366,84 @@ struct CFFT<TComplexArray2D,2>
     static bool FFT_inplace(TComplexArray2D & data, const size_t size1, const size_t size2,
                             const FFT_direction fft_direction, const char *& error_description)
     {
-        int n_rows = static_cast<int>(size1);
-        int n_cols = static_cast<int>(size2);
+        using namespace error_handling;
+
+        if(!checkNumElements(size1, error_description) ||
+           !checkNumElements(size2, error_description))
+        {
+            return false;
+        }
 
-        // fft for columns
-        std::vector<complex_type> subarray(n_rows); // each column has n_rows elements
+        if((FFT_FORWARD != fft_direction) && (FFT_BACKWARD != fft_direction)) {
+            GetErrorDescription(EC_WRONG_FFT_DIRECTION, error_description);
+            return false;
+        }
 
-        for(int j = 0; j < n_cols; ++j)
+        // fft for columns: blocks of adjacent columns are transposed into
+        // contiguous scratch of each thread, so that data is read by whole
+        // cache lines of rows instead of one element per row
+        size_t n_col_blocks = (size2 + TRANSPOSE_BLOCK_SIZE - 1) / TRANSPOSE_BLOCK_SIZE;
+        parallelFor(n_col_blocks, TRANSPOSE_BLOCK_SIZE * size1, [&](size_t block_begin, size_t block_end)
         {
-#ifndef __clang__
-#ifdef __USE_OPENMP
-#pragma omp parallel for
-#endif
-#endif
-            for(int i = 0; i < n_rows; ++i) {
+            std::vector<complex_type> scratch(TRANSPOSE_BLOCK_SIZE * size1);
+            complex_type * columns = scratch.data();
+
+            for(size_t block = block_begin; block < block_end; ++block)
+            {
+                size_t col_begin = block * TRANSPOSE_BLOCK_SIZE;
+                size_t col_end = std::min(col_begin + TRANSPOSE_BLOCK_SIZE, size2);
+
+                for(size_t i = 0; i < size1; ++i) {
+                    for(size_t j = col_begin; j < col_end; ++j) {
 #ifdef __USE_SQUARE_BRACKETS_FOR_ELEMENT_ACCESS_OPERATOR
-                subarray[i] = data[i][j];
+                        columns[(j - col_begin) * size1 + i] = data[i][j];
 #else
-                subarray[i] = data(i,j);
+                        columns[(j - col_begin) * size1 + i] = data(i,j);
 #endif
-            }
+                    }
+                }
 
-            if(!CFFT<std::vector<complex_type>,1>::FFT_inplace(subarray, size1,
-                                                               fft_direction,
-                                                               error_description))
-            {
-                return false;
-            }
+                transformLines(columns, size1, 0, col_end - col_begin, fft_direction);
 
-#ifndef __clang__
-#ifdef __USE_OPENMP
-#pragma omp parallel for
-#endif
-#endif
-            for(int i = 0; i < n_rows; ++i) {
+                for(size_t i = 0; i < size1; ++i) {
+                    for(size_t j = col_begin; j < col_end; ++j) {
 #ifdef __USE_SQUARE_BRACKETS_FOR_ELEMENT_ACCESS_OPERATOR
-                data[i][j] = subarray[i];
+                        data[i][j] = columns[(j - col_begin) * size1 + i];
 #else
-                data(i,j) = subarray[i];
+                        data(i,j) = columns[(j - col_begin) * size1 + i];
 #endif
+                    }
+                }
             }
-        }
+        });
 
         // fft for rows
-        subarray.resize(n_cols); // each row has n_cols elements
-
-        for(int i = 0; i < n_rows; ++i)
+        parallelFor(size1, size2, [&](size_t row_begin, size_t row_end)
         {
-#ifndef __clang__
-#ifdef __USE_OPENMP
-#pragma omp parallel for
-#endif
-#endif
-            for(int j = 0; j < n_cols; ++j) {
+            std::vector<complex_type> scratch(size2);
+            complex_type * row_data = scratch.data();
+
+            for(size_t i = row_begin; i < row_end; ++i)
+            {
+                for(size_t j = 0; j < size2; ++j) {
 #ifdef __USE_SQUARE_BRACKETS_FOR_ELEMENT_ACCESS_OPERATOR
-                subarray[j] = data[i][j];
+                    row_data[j] = data[i][j];
 #else
-                subarray[j] = data(i,j);
+                    row_data[j] = data(i,j);
 #endif
-            }
+                }
 
-            if(!CFFT<std::vector<complex_type>,1>::FFT_inplace(subarray, size2,
-                                                               fft_direction,
-                                                               error_description))
-            {
-                return false;
-            }
+                transformLines(row_data, size2, 0, 1, fft_direction);
 
-#ifndef __clang__
-#ifdef __USE_OPENMP
-#pragma omp parallel for
-#endif
-#endif
-            for(int j = 0; j < n_cols; ++j) {
+                for(size_t j = 0; j < size2; ++j) {
 #ifdef __USE_SQUARE_BRACKETS_FOR_ELEMENT_ACCESS_OPERATOR
-                data[i][j] = subarray[j];
+                    data[i][j] = row_data[j];
 #else
-                data(i,j) = subarray[j];
+                    data(i,j) = row_data[j];
 #endif
+                }
             }
-        }
+        });
 
         return true;
     }